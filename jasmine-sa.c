@@ -13,6 +13,14 @@
 #include <stdarg.h>
 #include <getopt.h>
 #include <errno.h>
+#include <time.h>
+#include <limits.h> // PATH_MAX
+#include <float.h> // FLT_MAX
+#include <sys/stat.h> // mkdir()
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <libgen.h> // basename()
 
 #include <math.h>
 #include <bsd/bsd.h> // strlcat()
@@ -29,10 +37,15 @@
 #include <X11/Xatom.h>
 #include <X11/extensions/Xrender.h>
 #include <X11/extensions/scrnsaver.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include <GL/glx.h>
 #define GLX_CONTEXT_MAJOR_VERSION_ARB 0x2091
 #define GLX_CONTEXT_MINOR_VERSION_ARB 0x2092
+#define GLX_CONTEXT_PROFILE_MASK_ARB 0x9126
+#define GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB 0x00000002
 typedef GLXContext (*glXCreateContextAttribsARBProc)(Display*, GLXFBConfig, GLXContext, Bool, const int*);
 
 #define C  "Ctrl"
@@ -63,16 +76,30 @@ static void usage(const char *name)
   printf("%s is multichannel hi-res Spectrum Analyzer for JACK\n"
   "Usage: %s [options] port1 [ port2 ... ]\n"
   "options:\n"
-  " -t, --fft-type=N         0: fftw3 double (default), 1: kfr double\n"
+  " -t, --fft-type=N         0: fftw3 double (default), 1: kfr double,\n"
+  "                            2: fftw3 float, 3: kfr float\n"
   " -k, --fft-kmax=N         max FFT size to 2^k. Default: 20\n"
   " -r, --roll=N             max roll factor, 1..256. Default: 16\n"
   " -j, --jobs=N             use 1 (default) to 4 fftw3's threads (aka jobs)\n"
+  " -W, --workers=N          process channels in parallel, 1 (default) to 8\n"
+  "                            threads (channel workers)\n"
+  " -B, --batch              one batched fftw3 plan for all channels\n"
+  " -Z, --zoom               zoom FFT for narrow spans: mix down to center and\n"
+  "                            decimate, then smaller FFT for same RBW\n"
+  " -I, --window-float       keep window tables as float, half the memory;\n"
+  "                            always so with -t 2, -t 3\n"
+  " -P, --planner=N          fftw3 planner: 0: estimate (default), 1: measure,\n"
+  "                            2: patient. Wisdom is cached between runs\n"
   " -h, --hz=N[,N[,N[,N]]]   X axis: min (Hz), max (Hz), grids,\n"
   "                            grid cell size (px). Default: 0,20000,10,50\n"
   " -d, --db=N[,N[,N[,N]]]   Y axis: min (dBV), max (dBV), grids,\n"
   "                            grid cell size (px). Default: -100,0,10,50\n"
   " -D, --db-pwr=...         same as -d, but with dB Power units\n"
   " -p, --phosphor=N         auto memory levels, 1..16. Default: 0\n"
+  " -U, --waterfall=N        waterfall of marker's channel below plot,\n"
+  "                            N rows of history. Default: 0 (off)\n"
+  " -E, --density=N          density display, hits fade with half-life\n"
+  "                            N ms (F3 of menu 1). Default: off, 1000\n"
   " -u, --subgrid-size=N     sub-grid pitch, px. Default: 5,\n"
   "                            zero for no grid\n"
   " -i, --iq-input           assume inputs as complex pairs,\n"
@@ -111,6 +138,25 @@ static void usage(const char *name)
   "                                when low FPS, but can be hidden always\n"
   "                           128: Invert luma (brightness)\n"
   " -O, --opengl             use openGL\n"
+  " -C, --gl-shader          openGL 3.3 shader trace renderer, implies -O\n"
+  " -R, --read=FILE          analyse WAV / RF64 file instead of JACK ports;\n"
+  "                            raw float 32 as FILE,RATE,CHANNELS\n"
+  " -G, --generate=SPEC      synthetic input instead of JACK ports:\n"
+  "                            RATE[:SEC],SRC[,SRC...], one SRC per channel:\n"
+  "                            sine:HZ, enob:HZ[:BITS], noise[:DBFS],\n"
+  "                            multi:HZ[:HZ...], chirp:HZ0:HZ1:SEC\n"
+  " -L, --fast               read file or generate as fast as CPU allows\n"
+  " -H, --headless=FILE      no X11: write spectra to FILE ('-' is stdout),\n"
+  "                            binary records, see README\n"
+  " -Q, --csv                with -H, write CSV instead of binary\n"
+  " -Y, --bench=FILE         time Stages 1, 2, 3 over FFT sizes, backends, jobs,\n"
+  "                            channels, windows, real/IQ and batched; print\n"
+  "                            table, write JSON to FILE. -t, -j, -i, -B fix\n"
+  "                            their axis\n"
+  " -a, --autocal=PCT        limit FPS and RBW to what Stages 1, 2, 3 can do\n"
+  "                            in PCT %% of CPU, 10..100; measured once, cached\n"
+  " -X, --shm                software trace renderer, one image per frame\n"
+  "                            (MIT-SHM when local), X11 only\n"
   " -M, --msaa=N             use MSAA, 0..4. Default: 0\n"
   " -A, --alpha=N            use Alpha transparency, 0 or 1 (default),\n"
   "                            see also -o\n"
@@ -119,22 +165,30 @@ static void usage(const char *name)
   " -x, --x-pos=N            position on screen, px\n"
   " -y, --y-pos=N            position on screen, px\n"
   " -w, --rev-wheel          reverse mouse wheel\n"
+  " -T, --trace=FILE         write per-stage timings as Chrome trace JSON\n"
   " -v, --verbose=N          message filter, 0..4. Default: 2\n"
   "port1 [ port2 ... ]       use 'jack_lsp' to see all \n", name, name, fontColors, rayColors, satLuma, MAXMEM - 1);
 }
 
 static const char *shortopts =
-  "t:k:r:j:h:d:D:p:u:iezc:q:l:s:fm:g:o:b:OM:A:S:F:x:y:wv:";
+  "t:k:r:j:W:BIZP:h:d:D:p:E:U:u:iezc:q:l:s:fm:g:o:b:OCXR:G:LH:QY:a:M:A:S:F:x:y:wT:v:";
 
 static const struct option longopts[] = {
   {"fft-type",     1, 0, 't'},
   {"fft-kmax",     1, 0, 'k'},
   {"roll",         1, 0, 'r'},
   {"jobs",         1, 0, 'j'},
+  {"workers",      1, 0, 'W'},
+  {"batch",        0, 0, 'B'},
+  {"window-float", 0, 0, 'I'},
+  {"zoom",         0, 0, 'Z'},
+  {"planner",      1, 0, 'P'},
   {"hz",           1, 0, 'h'},
   {"db",           1, 0, 'd'},
   {"db-pwr",       1, 0, 'D'},
   {"phosphor",     1, 0, 'p'},
+  {"density",      1, 0, 'E'},
+  {"waterfall",    1, 0, 'U'},
   {"subgrid-size", 1, 0, 'u'},
   {"iq-input",     0, 0, 'i'},
   {"enob",         0, 0, 'e'},
@@ -149,6 +203,15 @@ static const struct option longopts[] = {
   {"opacity",      1, 0, 'o'},
   {"bits",         1, 0, 'b'},
   {"opengl",       0, 0, 'O'},
+  {"gl-shader",    0, 0, 'C'},
+  {"shm",          0, 0, 'X'},
+  {"read",         1, 0, 'R'},
+  {"generate",     1, 0, 'G'},
+  {"fast",         0, 0, 'L'},
+  {"headless",     1, 0, 'H'},
+  {"csv",          0, 0, 'Q'},
+  {"bench",        1, 0, 'Y'},
+  {"autocal",      1, 0, 'a'},
   {"msaa",         1, 0, 'M'},
   {"alpha",        1, 0, 'A'},
   {"opengl-scale", 1, 0, 'S'},
@@ -156,6 +219,7 @@ static const struct option longopts[] = {
   {"x-pos",        1, 0, 'x'},
   {"y-pos",        1, 0, 'y'},
   {"rev-wheel",    0, 0, 'w'},
+  {"trace",        1, 0, 'T'},
   {"verbose",      1, 0, 'v'},
   {0, 0, 0, 0}
 };
@@ -183,10 +247,14 @@ int crtRayStyle = 0;  // 0 = Auto
 int optRayFade = 0;
 int memorySlots = MAXMEM - 1;
 int defPhospor = 0;
+int density = 0;     // Density display, -E
+int densityMs = 1000; // its half-life
 
 int windowBits = 0;
 
-int optType = 0;
+int optType = 0;   // Bit 0: kfr, else fftw3; bit 1: single precision
+#define KFR (optType & 1)
+#define SINGLE (optType & 2)
 int maxFFTK = 20;
 int maxRoll = 16;
 int optIQ = 0;
@@ -196,8 +264,18 @@ int opacity = 100;  // background, 0...100 %
 int verbose = 2;    // 0...4
 int optRevWheel = 0;
 int jobs = 1;
+int workers = 1;
+int optBatch = 0;
+int planner = 0;    // 0...2: FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT
 
 int optOpengl = 0;
+int optGlCore = 0; // openGL 3.3 shader trace renderer
+int optShm = 0;    // Software trace renderer, MIT-SHM
+char *optRead = NULL; // File source instead of JACK
+char *optGen = NULL;  // Synthetic source instead of JACK
+char *optHeadless = NULL; // Spectra go to this file, no X11
+int optCsv = 0;
+int optFast = 0;      // File is read as fast as engine goes
 int optAlpha = 1;
 int optMsaa = 0;
 
@@ -231,8 +309,36 @@ float scalingYcoe0, scalingYcoe1;
 #define intDbScale 100
 
 // It is essentially important to keep arrays as small as possible, due to memory page switch latency have bad effects. This is a reason for int16s.
-int16_t data[MAXMEM][MAXDATA][MAXCH];
+// Traces are [mem][ch][bin], sized to real channels and xSize, so both Stage 3 and plot walk one channel sequentially.
+int16_t *data;
+int dataBins; // xSize / MINSTEP + 1
 #define NODATA (int16_t) -32768
+#define TRACE(d, mem, ch) ((d) + ((mem) * channels + (ch)) * (uint64_t)dataBins)
+
+// Trace (mem, ch) holds bins lo ... hi, written for screen generation gen; others read as NODATA. So screen clear
+// is just screenGen++, no memset.
+typedef struct
+{
+  int gen, lo, hi;
+} trace_t;
+trace_t trace[MAXMEM][MAXCH];
+
+// Engine works on 'data' above, then publishes used part of it as frame. Display thread plots latest published frame, so slow plot never stalls FFT and vice versa. Three frames are enough for nobody to wait.
+typedef struct
+{
+  int16_t *data;
+  trace_t trace[MAXMEM][MAXCH];
+  int16_t *wf; // Waterfall row, [ch][dataBins]
+  int memCurr, memQty;
+  int firstUsedBin, lastUsedBin;
+  int amptZero, amptMax, amptOverload;
+  int lowCpu;
+  int gen; // screenGen it was made for
+} frame_t;
+
+frame_t frames[3];
+frame_t *shown = &frames[2]; // Display thread's one.
+int screenGen = 0;           // Bumped on each screen clear.
 
 int memCurr = 0, memPrev;
 int memAddScheduled = 0;
@@ -254,8 +360,9 @@ int rePlot;
 int phosphor;
 int firstUsedBin, lastUsedBin;
 
-int amptZero, amptMax, amptOverload;
+int amptZero = -1, amptMax = -1, amptOverload = -1;
 int lowCpu;
+float rollPos; // For progressbar.
 
 int mkrIsDelta;
 int marker[2];
@@ -283,9 +390,31 @@ Atom wm_delete_window;
 XSetWindowAttributes attr;
 GLXContext glcontext = 0;
 XVisualInfo visual;
-Pixmap pm, pmMkr;
-#define mkrW 192
-#define mkrH 64
+Pixmap pm;
+// Static plot background (cleared plot area and sub-grid), made once per newScreen() and copied each frame.
+Pixmap pmBase;
+int baseValid = 0;
+// openGL: whole window copy of pm as texture. Only rectangle of pm changed since last frame is uploaded.
+GLuint baseTex = 0;
+int dirtyX0, dirtyY0, dirtyX1, dirtyY1; // Empty when X1 <= X0
+
+void baseDirty(int x, int y, int w, int h)
+{
+  if (dirtyX1 <= dirtyX0)
+  {
+    dirtyX0 = x;
+    dirtyY0 = y;
+    dirtyX1 = x + w;
+    dirtyY1 = y + h;
+  }
+  else
+  {
+    dirtyX0 = MIN(dirtyX0, x);
+    dirtyY0 = MIN(dirtyY0, y);
+    dirtyX1 = MAX(dirtyX1, x + w);
+    dirtyY1 = MAX(dirtyY1, y + h);
+  }
+}
 int depth = 0;
 
 // Corner shifts
@@ -337,17 +466,35 @@ uint32_t plotSamplesNum;
 float fftPlotTime, fftsPerSecond, framesPerSecond;
 
 uint64_t fftSizeK, fftOldSizeK;
+uint64_t fftWantK; // Size newFft() wants; fftSizeK is nearest ready one until wanted is built.
+// Zoom FFT (-Z): input is mixed down to span center (zoomHz), decimated by zoomD = 2^zoomStages, so FFT runs at fsFft.
+int optZoom = 0;
+int zoomStages = 0, zoomD = 1;
+double zoomHz = 0, fsFft;
+int zoomGen = 0; // Bumped when decimator should restart
 fftw_complex *fftin[MAXCH];
 double *fftinR[MAXCH], inmin[MAXCH], inminAbsNonzero[MAXCH], inmax[MAXCH];
 
 #define MINFFTK 13
 #define MAXFFTK 25  // 31 is max.
 #define MAXPLANS (MAXFFTK - MINFFTK + 1)
+#define MAXZOOM 10  // Zoom FFT decimation stages, -Z
 fftw_complex *fftout[MAXCH];
-fftw_plan plan_fftw[MAXPLANS][MAXCH];
+// Single precision: same buffers, as float. Sample is float from JACK up to FFT output then.
+fftwf_complex *fftinF[MAXCH], *fftoutF[MAXCH];
+float *fftinRF[MAXCH];
+fftw_plan plan_fftw[MAXPLANS]; // Same plan for all channels, with new-array execute
+fftw_plan plan_batch[MAXPLANS]; // One plan for all channels, -B
+fftwf_plan plan_fftwf[MAXPLANS], plan_batchf[MAXPLANS];
+fftw_plan plan_fftwz[MAXPLANS];  // Complex plans for zoomed input, also with -B, see -Z
+fftwf_plan plan_fftwzf[MAXPLANS];
+uint64_t batchInDist, batchOutDist; // Channel offsets in batched buffers
+uint64_t realSize; // sizeof(float) or sizeof(double)
 KFR_DFT_PLAN_F64* plan_kfr[MAXPLANS];
 KFR_DFT_REAL_PLAN_F64* plan_kfr_real[MAXPLANS];
-uint8_t* tmp = NULL;
+KFR_DFT_PLAN_F32* plan_kfr_f32[MAXPLANS];
+KFR_DFT_REAL_PLAN_F32* plan_kfr_real_f32[MAXPLANS];
+uint8_t* tmp[MAXCH]; // Per channel worker.
 
 // 0: No/Custom, 1: Hanning, 2: FlatTop, 3: HFT144D.  [1] [2]
 // Long Chebyshev windows are takes too long time (months) to calc. (120, 150 att)
@@ -355,7 +502,11 @@ uint8_t* tmp = NULL;
 #define DEFWIN 3 // HFT144D
 int fftWindow[MAXCH];
 char *fftWindowStr[MAXWIN] = {"Blackmn", "Hanning", "FlatTop", "HFT144D"};
+// Left half of window only, size/2 values; built only for sizes and windows in use, see windowsEnsure().
 double *windowfunc[MAXPLANS][MAXWIN];
+float *windowfuncF[MAXPLANS][MAXWIN]; // Same, when -I
+int optWinFloat = 0;
+uint64_t windowBytes = 0; // Footprint of all tables
 
 // 0: Tone (Max), 1: Noise minus window NF (Avg)
 #define MAXMEASMODE 2
@@ -381,6 +532,9 @@ uint64_t roll; // min=1 max=2^n
 int rollPhase = 0;
 float stepAbs, stepRel;
 int squeeze;
+// Screen bin (column) b takes FFT samples colStart[b] ... colStart[b + 1] - 1, relative to first plotted one.
+int colStart[MAXDATA + 1];
+int cols;
 
 uint64_t channels;
 
@@ -389,12 +543,139 @@ uint64_t jackPorts;
 int64_t sampleRate; // Not uint64_t
 const size_t sample_size_4bytes = sizeof(jack_default_audio_sample_t);
 char portName[MAXCH][64];
+// jack_process() own cost, us: last, max, and sum for average. Written by RT thread only.
+uint64_t processUsec = 0, processUsecMax = 0, processUsecSum = 0, processCalls = 0;
+jack_nframes_t processFrames = 0;
 
 // Common useful things
 #define FIT(x, min, max) (x < min ? min : x > max ? max : x)
 #define BYTE(x, n) (((uint8_t *)&x)[n])
 
 
+// Pipeline instrumentation: per-stage timers, each keeps per-frame total into rolling log2 histogram.
+// Engine stages (ringbuffer read, Stage 1...3) and display stages are committed separately.
+enum { T_READ, T_DDC, T_WINDOW, T_FFT, T_POST, T_BASE, T_PLOT, T_FLUSH, TIMERS };
+char *timerStr[TIMERS] = {"Read", "DDC", "Window", "FFT", "Post", "Base", "Plot", "Flush"};
+// Bucket b holds frames of [2^(b-1), 2^b) us.
+#define HISTBINS 24
+// Rolling window, ns of audio; it is halved when exceeded.
+#define TIMERWINDOW 2000000000UL
+
+typedef struct
+{
+  uint64_t frameNs; // Current frame, so far
+  uint64_t sumNs;   // Rolling sum
+  uint64_t frames;  // Rolling frames count
+  uint64_t baseNs;  // Rolling window start, as audioNs
+  uint32_t hist[HISTBINS];
+} stage_timer_t;
+
+stage_timer_t timers[TIMERS];
+uint64_t audioNs = 0; // Audio time consumed by engine so far.
+uint64_t overruns = 0; // Samples lost, ringbuffer was full
+int optTiming = 0;    // Legend shows timers instead of channels.
+FILE *traceFile = NULL;
+uint64_t traceT0;
+uint64_t traceOverruns = 0; // Last value written as counter
+__thread int traceTid = 1; // Engine 1, display 2, channel workers 10 + n.
+
+uint64_t nsNow(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000UL + t.tv_nsec;
+}
+
+// Usage: uint64_t t = nsNow(); ...; timerAdd(T_FFT, t, ch); Use ch < 0 if not per channel.
+void timerAdd(int stage, uint64_t start, int ch)
+{
+  uint64_t end = nsNow();
+  // Channel workers can add at same time.
+  __atomic_fetch_add(&timers[stage].frameNs, end - start, __ATOMIC_RELAXED);
+
+  if (traceFile)
+    fprintf(traceFile, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"ch\":%d}},\n",
+        timerStr[stage], (start - traceT0) / 1000.0, (end - start) / 1000.0, traceTid, ch);
+}
+
+void timersCommit(int first, int last)
+{
+  for (int t = first; t <= last; t++)
+  {
+    stage_timer_t *st = &timers[t];
+    uint64_t us = st->frameNs / 1000;
+
+    st->hist[MIN(us ? 64 - __builtin_clzl(us) : 0, HISTBINS - 1)]++;
+    st->sumNs += st->frameNs;
+    st->frames++;
+    st->frameNs = 0;
+
+    if (audioNs - st->baseNs > TIMERWINDOW)
+    {
+      st->sumNs /= 2;
+      st->frames /= 2;
+      for (int b = 0; b < HISTBINS; b++)
+        st->hist[b] /= 2;
+      st->baseNs = audioNs - (audioNs - st->baseNs) / 2;
+    }
+  }
+}
+
+// Percent of real-time budget, i.e. of audio time processed.
+float timerLoad(int t)
+{
+  uint64_t span = audioNs - timers[t].baseNs;
+  return span ? timers[t].sumNs * 100.0 / span : 0;
+}
+
+// Upper bound of per-frame time, us, for given fraction of frames.
+uint64_t timerPercentile(int t, float fraction)
+{
+  uint64_t total = 0, n = 0;
+  for (int b = 0; b < HISTBINS; b++)
+    total += timers[t].hist[b];
+
+  for (int b = 0; b < HISTBINS; b++)
+  {
+    n += timers[t].hist[b];
+    if (n >= total * fraction)
+      return 1UL << b;
+  }
+  return 0;
+}
+
+// Overruns as counter track, written when changed; engine calls it once per frame.
+void traceOverrunsCounter(void)
+{
+  uint64_t n = __atomic_load_n(&overruns, __ATOMIC_RELAXED);
+  if ((traceFile) && (n != traceOverruns))
+  {
+    fprintf(traceFile, "{\"name\":\"overruns\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"samples\":%ld}},\n",
+        (nsNow() - traceT0) / 1000.0, n);
+    traceOverruns = n;
+  }
+}
+
+void traceOpen(char *name)
+{
+  traceFile = fopen(name, "w");
+  if (! traceFile)
+    ERR(S, "Can't open trace file '%s': %s.", name, strerror(errno));
+  traceT0 = nsNow();
+  fprintf(traceFile, "[\n");
+}
+
+void traceClose(void)
+{
+  if (! traceFile)
+    return;
+  // Closing event keeps JSON valid after trailing comma.
+  fprintf(traceFile, "{\"name\":\"exit\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":1}\n]\n", (nsNow() - traceT0) / 1000.0);
+  fclose(traceFile);
+  traceFile = NULL;
+}
+
+
 // Colors, and HSL->RGB [11] [12]
 // I try to rewrite [12] to integer-only: bytes in and bytes out.
 // To be even simpler, we need to limit hue span to 102 (0...0x66) or 204 (0...0xcc).
@@ -437,6 +718,7 @@ GC bgColor, transparentColor;
 GC fontColor[10];
 GC lineColor[8 * GRADIENTS][2]; // CRT ray: thin, thick
 uint32_t lineColorAbgr[8 * GRADIENTS];
+uint32_t lineColorPixel[8 * GRADIENTS]; // For software renderer, -X
 
 void setFontAndColors(void)
 {
@@ -471,6 +753,7 @@ void setFontAndColors(void)
       uint32_t fg = ahsl2argb(255, BYTE(rayColors, ch), (int)(BYTE(satLuma, 5) * fade), (int)(BYTE(satLuma, 4) * fade));
       int c = ch * GRADIENTS + grad;
       lineColorAbgr[c] = (__builtin_bswap32(fg) >> 8) | 0xff000000;
+      lineColorPixel[c] = fg;
 
       // Thickness.
       for (int t = 0; t < 2; t++)
@@ -488,6 +771,7 @@ void XFlushArea(int a, int b, int c, int d)
 {
   XCopyArea(dpy, pm, win, bgColor, a, b, c, d, a, b);
   XFlush(dpy);
+  baseDirty(a, b, c, d);
 }
 
 // Font engine, should be used with bitmap 'fixed' 6x13 guaranteed to be available and fastest possible.
@@ -546,6 +830,8 @@ void plotStr(const char *fmt, ...)
     XDrawString(dpy, pm, color, xx + centeringOffset, yy + glyphH - 2, buffer, strlen(buffer));
   }
 
+  baseDirty(xx + centeringOffset, yy, textWidth, glyphH);
+
   // These special colors causes immediate update.
   if (((fgcolor == 5) || (fgcolor == 6)) && (! optOpengl))
     XFlushArea(xx + centeringOffset, yy, textWidth, glyphH);
@@ -566,7 +852,7 @@ void plotBottomHelp(void)
   if (menuPage == 0)
     plotStr("Center    Span      RBV       %s   %s   Memory    Y Shift   %s   Stop       Menu: 0", (vbw)?"VBW    ":"MaxHold", (mkrIsDelta)?"MkDelta":"Marker ", (isDbPwr)?"dBVolts":"dBPower");
   else if (menuPage == 1)
-    plotStr("Stats                                   MkrCntr   stepRel   Phospho   LnStyle   Reset      Menu: 1");
+    plotStr("Stats     Timing    Density             MkrCntr   stepRel   Phospho   LnStyle   Reset      Menu: 1");
   else
     plotStr("Ch.1      Ch.2      Ch.3      Ch.4      Ch.5      Ch.6      Ch.7      Ch.8      All        Menu: 2");
 
@@ -604,11 +890,8 @@ void printParam(void)
 #define PLOTAREA DX - mkrSize, DY - mkrSize, xSize + mkrSize * 2 + 1, ySize + mkrSize * 2 + 1
 #define COLOR(ch, fade) ((ch % 8) * GRADIENTS + (fade % 16))
 
-void newPlot()
+void gridDraw(Drawable d)
 {
-  if (phosphor < MAXPHOSPHOR)
-    XFillRectangle(dpy, pm, bgColor, PLOTAREA);
-
   if (subGridSize > 1)
   {
     nPoints = 0;
@@ -624,22 +907,65 @@ void newPlot()
       for (int i = 0; i < ySize / subGridSize; i++)
         ADDPOINT(j * xGridSize, i * subGridSize);
 
-    XDrawPoints(dpy, pm, fontColor[0], points, nPoints, CoordModeOrigin);
+    XDrawPoints(dpy, d, fontColor[0], points, nPoints, CoordModeOrigin);
+  }
+}
+
+char statusKey[1024];
+
+int swBaseStale;
+
+void baseBuild(void)
+{
+  XFillRectangle(dpy, pmBase, bgColor, PLOTAREA);
+  gridDraw(pmBase);
+  baseValid = 1;
+  statusKey[0] = '\0';
+  swBaseStale = 1;
+}
+
+void newPlot()
+{
+  if (! baseValid)
+    baseBuild();
+
+  // openGL plots traces by itself, so pm only changes with status lines below; it is not redrawn (and uploaded) if they are same.
+  // Stats change each frame.
+  if (optOpengl)
+  {
+    char key[sizeof(statusKey)];
+    snprintf(key, sizeof(key), "%d %d %d %d %d %s%s%s", shown->amptOverload, shown->amptMax, shown->amptZero, shown->lowCpu,
+        (! stopped) && (stats), resultStr, inputName, inputStr);
+    if ((! strcmp(key, statusKey)) && (! ((! stopped) && (stats))))
+      return;
+    strcpy(statusKey, key);
+  }
+
+  if (optOpengl)
+  {
+    // Only band of status lines is restored, to keep upload small.
+    int h = MIN(24 + (channels + 3) * vtab, ySize);
+    XCopyArea(dpy, pmBase, pm, bgColor, DX, DY, xSize, h, DX, DY);
+    baseDirty(DX, DY, xSize, h);
   }
+  else if (optShm)
+    ; // Plot area is already there, see swBegin().
+  else if (phosphor < MAXPHOSPHOR)
+    XCopyArea(dpy, pmBase, pm, bgColor, PLOTAREA, DX - mkrSize, DY - mkrSize);
+  else
+    gridDraw(pm);
 
   plotGotoXY(DX + 6, DY + 20);
   plotSetColors(3, 0);
 
-  if (amptOverload >= 0)
-    plotStr("Level Overload ch.%d", amptOverload);
-  else if (amptMax >= 0)
-    plotStr("Level Max ch.%d", amptMax);
-  else if (amptZero >= 0)
-    plotStr("Zero Input ch.%d", amptZero);
-
-  amptZero = amptMax = amptOverload = -1;
+  if (shown->amptOverload >= 0)
+    plotStr("Level Overload ch.%d", shown->amptOverload);
+  else if (shown->amptMax >= 0)
+    plotStr("Level Max ch.%d", shown->amptMax);
+  else if (shown->amptZero >= 0)
+    plotStr("Zero Input ch.%d", shown->amptZero);
 
-  if (lowCpu)
+  if (shown->lowCpu)
     plotStr("Low CPU.");
 
   if ((! stopped) && (stats)) {
@@ -649,6 +975,9 @@ void newPlot()
       plotSetColors(i + 10, -3);
       plotStr("%.3f..%.3f, z %.3f", inmin[i], inmax[i], log2(inminAbsNonzero[i]) - 1); // Sign bit also counts.
     }
+    // JACK RT thread cost: last and max callback time vs its period.
+    plotSetColors(2, -3);
+    plotStr("JACK cb %ld (max %ld) us of %.0f", processUsec, processUsecMax, processFrames * 1e6 / sampleRate);
   }
 
   printParam();
@@ -662,6 +991,41 @@ void newPlot()
 #define RBW2STR rbw > 1 ? "RBW: %.4g Hz/S (1/%gx)" : "RBW: %.4g Hz/S (%gx)", 2.0 / fftPlotTime, rbw > 1 ? rbw : 1 / rbw
 #define VBW2STR vbw == 0 ? "VBW: Max Hold" : vbw == 1 ? "VBW: Full" : "VBW: 1/%dx", vbw
 
+// Timers page of legend, below common lines. Redrawn each frame while shown.
+int legendTimingY;
+uint64_t legendTimingNs = 0;
+
+void legendTiming(void)
+{
+  if ((windowBits & 32) || (! optTiming))
+    return;
+
+  XFillRectangle(dpy, pm, bgColor, winW - LEGENDWIDTH, legendTimingY, LEGENDWIDTH, winH - legendTimingY);
+
+  plotGotoXY(DX + xSize + DX - 2, legendTimingY + 4);
+  plotSetColors(2, -1);
+  plotStr("Stage  %% of RT  p50  p99");
+
+  float total = 0;
+  for (int t = 0; t < TIMERS; t++)
+  {
+    uint64_t p50 = timerPercentile(t, 0.5), p99 = timerPercentile(t, 0.99);
+    total += timerLoad(t);
+    plotSetColors((timerLoad(t) < 50.0) ? 1 : 3, -1);
+    plotStr("%-6s %6.1f %3ld%s %3ld%s", timerStr[t], timerLoad(t),
+        (p50 < 1000) ? p50 : p50 / 1000, (p50 < 1000) ? "u" : "m",
+        (p99 < 1000) ? p99 : p99 / 1000, (p99 < 1000) ? "u" : "m");
+  }
+  plotSetColors((total < 100.0) ? 2 : 3, -1);
+  plotStr("Total  %6.1f", total);
+  plotSetColors(overruns ? 3 : 1, -1);
+  plotStr("Overruns %ld S", overruns);
+  plotSetColors(1, -1);
+  plotStr("Window tables %.1f MB", windowBytes / 1e6);
+
+  legendTimingNs = nsNow();
+}
+
 void legend(void)
 {
   if (windowBits & 32)
@@ -672,8 +1036,17 @@ void legend(void)
   plotGotoXY(DX + xSize + DX - 2, 5);
   plotSetColors(2, -1);
   plotStr("Fs: %g kHz", sampleRate / 1000.0);
-  plotStr(optType ? "KFR Double, auto thrd" : "FFTW3 Double, %d thrd", jobs);
-  plotStr("FFT: %ld", (1UL << fftSizeK));
+  plotStr(KFR ? "KFR %s, auto thrd" : "FFTW3 %s, %d thrd", SINGLE ? "Float" : "Double", jobs);
+  if (workers > 1)
+    plotStr("Channel workers: %d", workers);
+  if (optBatch)
+    plotStr("Batched FFT: %ld ch", channels);
+  if (fftWantK != fftSizeK)
+    plotStr("FFT: %ld (%ld soon)", (1UL << fftSizeK), (1UL << fftWantK));
+  else
+    plotStr("FFT: %ld", (1UL << fftSizeK));
+  if (zoomD > 1)
+    plotStr("Zoom: x%d, Fs %g Hz", zoomD, fsFft);
   plotStr("Start:  %.6g %s", startHz DUNITS2STR);
   plotStr("Stop:   %.6g %s", (startHz + spanHz) DUNITS2STR);
   plotStr("Center: %.6g %s", (startHz + spanHz / 2.0) DUNITS2STR);
@@ -683,20 +1056,26 @@ void legend(void)
   plotStr("FPS: %.4g x %ld", fftsPerSecond, roll);
   plotStr("Step: %.4g %s", stepAbs * stepRel, squeeze ? "" : "(Exact mkr)");
   plotStr(PHOSPHOR2STR);
+  if (density)
+    plotStr("Density: %d ms", densityMs);
 
-  for (int i = 0; i < channels; i++)
-  {
-    yy += 4;
-    plotSetColors(i + 10, -1);
-    if (optIQ)
+  legendTimingY = yy;
+  if (optTiming)
+    legendTiming();
+  else
+    for (int i = 0; i < channels; i++)
     {
-      plotStr("Ch. %d: %s", i, portName[i * 2]);
-      plotStr("     & %s", portName[i * 2 + 1]);
+      yy += 4;
+      plotSetColors(i + 10, -1);
+      if (optIQ)
+      {
+        plotStr("Ch. %d: %s", i, portName[i * 2]);
+        plotStr("     & %s", portName[i * 2 + 1]);
+      }
+      else
+        plotStr("Ch. %d: %s", i, portName[i]);
+      plotStr("%s %s", measModeStr[measMode[i]], fftWindowStr[fftWindow[i]]);
     }
-    else
-      plotStr("Ch. %d: %s", i, portName[i]);
-    plotStr("%s %s", measModeStr[measMode[i]], fftWindowStr[fftWindow[i]]);
-  }
 
   XFlushArea(winW - LEGENDWIDTH, 0, LEGENDWIDTH, winH);
 }
@@ -704,7 +1083,8 @@ void legend(void)
 void newScreen(int clear)
 {
   if (clear) {
-    memset(data, NODATA, sizeof(data));
+    // Traces of older generation read as NODATA, see trace_t.
+    screenGen++;
     marker[0] = marker[1] = -1;
     vbwContinue = 0;
   }
@@ -712,6 +1092,11 @@ void newScreen(int clear)
   scalingYcoe0 = yGridSize / (float)yDbStep * (float)yDbMax;
   scalingYcoe1 = yGridSize / (float)yDbStep / (float)intDbScale;
 
+  // Headless and bench have nothing to draw on.
+  if (! dpy)
+    return;
+
+  baseValid = 0;
   XFillRectangle(dpy, pm, bgColor, 0, 0, winW, winH);
 
   if (! (windowBits & 16))
@@ -751,7 +1136,8 @@ void newScreen(int clear)
   // Testcase: 12-bit 8192p FFT, [4]:fig. 2 (NOTE: Units there, are dB pwr)
   // ENOB = (SINADpwr − 1.76 dBpwr) / 6.02
       plotSetColors(1, -1);
-      for (int bits = 8; bits < 48; bits++)
+      // Single precision FFT is itself a noise source about float mantissa (24 bits), see README.
+      for (int bits = 8; bits < (SINGLE ? 24 : 48); bits++)
       {
         float dBsnrPwr = 6.02 * bits + 1.76;
         float dBfftGain = 10.0 * log10(fftSize);
@@ -771,1083 +1157,3369 @@ void newScreen(int clear)
   XFlushArea(0, 0, winW - LEGENDWIDTH, winH);
 }
 
-
-void plotOneChannel(int ch)
+// Shader trace renderer, -C. Traces of shown frame are copied to GL buffer in same [mem][ch][bin] layout, and vertex
+// shader makes screen points of them by itself: x, y scaling, colors and CRT fade. All memory slots of channel are one
+// instanced draw call. Needs openGL 3.3; buffer is persistently mapped if GL has ARB_buffer_storage.
+// Unlike X11 and legacy GL, line is cut at NODATA bin instead of joining valid points around it: strip can't skip vertex.
+GLuint trProg, trVao, trVbo, trTex;
+int16_t *trMap = NULL; // NULL: glBufferSubData() is used
+GLsync trFence = 0;
+
+// Uniform locations, looked up once at trInit().
+enum {U_FIRST, U_XSHIFT, U_XSIZE, U_YSIZE, U_RAYFADE, U_ROWOF, U_FADEOF, U_RANGE, U_PALETTE, U_STEPX, U_COE0, U_COE1,
+  U_ORIGIN, U_VIEW, U_NUM};
+static const char *trUniName[U_NUM] = {"first", "xShift", "xSize", "ySize", "rayFade", "rowOf", "fadeOf", "range",
+  "palette", "stepX", "coe0", "coe1", "origin", "view"};
+static GLint trUni[U_NUM];
+
+static const char *trVertSrc =
+  "#version 330\n"
+  "uniform isamplerBuffer traces;\n"
+  "uniform int first, xShift, xSize, ySize, rayFade;\n"
+  "uniform int rowOf[16], fadeOf[16];\n"        // Per instance (MAXMEM), oldest slot first
+  "uniform ivec2 range[16];\n"
+  "uniform vec4 palette[16];\n"
+  "uniform float stepX, coe0, coe1;\n"
+  "uniform vec2 origin, view;\n"
+  "flat out vec4 color;\n"
+  "out float valid;\n"
+  "int screenY(int v) { return clamp(int(coe0 - float(v) * coe1), 0, ySize); }\n"
+  "void main()\n"
+  "{\n"
+  "  int i = gl_InstanceID;\n"
+  "  int bin = first + gl_VertexID;\n"
+  "  int v = texelFetch(traces, rowOf[i] + bin).r;\n"
+  "  int x = int(float(bin) * stepX) + xShift;\n"
+  "  int y = screenY(v);\n"
+  "  valid = ((v != -32768) && (bin >= range[i].x) && (bin <= range[i].y) && (x >= 0) && (x <= xSize)) ? 1.0 : 0.0;\n"
+  "  int g = fadeOf[i];\n"
+  "  int u = texelFetch(traces, rowOf[i] + bin - 1).r;\n"
+  "  int xu = int(float(bin - 1) * stepX) + xShift;\n"
+  // Line takes color of its last vertex, same as RAYFADE(), which sees valid points only; 32 is GRADIENTS.
+  "  if ((rayFade != 0) && (bin > first) && (u != -32768) && (bin - 1 >= range[i].x) && (xu >= 0))\n"
+  "    g = min(g + min(abs(y - screenY(u)) / 4, 32), 31);\n"
+  "  color = palette[g % 16];\n"
+  "  vec2 p = origin + vec2(x, y) + 0.5;\n"
+  "  gl_Position = vec4(p.x / view.x * 2.0 - 1.0, 1.0 - p.y / view.y * 2.0, 0.0, 1.0);\n"
+  "}\n";
+
+static const char *trFragSrc =
+  "#version 330\n"
+  "flat in vec4 color;\n"
+  "in float valid;\n"
+  "out vec4 frag;\n"
+  "void main()\n"
+  "{\n"
+  "  if (valid < 0.999)\n"
+  "    discard;\n"
+  "  frag = color;\n"
+  "}\n";
+
+GLuint trShader(GLenum type, const char *src)
 {
-  int pointThick = crtRayStyle % 3;
-  int lineThick  = crtRayStyle / 3;
-  if (! crtRayStyle) { // Auto
-    pointThick = stepAbs > 4 ? 2 : 0;
-    lineThick = 1;
+  GLint ok;
+  GLuint sh = glCreateShader(type);
+  glShaderSource(sh, 1, &src, NULL);
+  glCompileShader(sh);
+  glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+  if (! ok)
+  {
+    char log[1024];
+    glGetShaderInfoLog(sh, sizeof(log), NULL, log);
+    ERR(O, "Shader compile failed: %s", log);
   }
+  return sh;
+}
 
-  // Draw from last to 1st to make fresh data on top. 0 = actual, 1-... = memory
-  for (int m = memQty - 1; m >= 0; m--)
+void trInit(void)
+{
+  GLint ok, n, maxTexels;
+  uint64_t texels = MAXMEM * channels * dataBins;
+
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+  if (texels > maxTexels)
+    ERR(O, "Traces need %ld texels of buffer texture, GL has %d. Use smaller plot, or no -C.", texels, maxTexels);
+
+  trProg = glCreateProgram();
+  glAttachShader(trProg, trShader(GL_VERTEX_SHADER, trVertSrc));
+  glAttachShader(trProg, trShader(GL_FRAGMENT_SHADER, trFragSrc));
+  glLinkProgram(trProg);
+  glGetProgramiv(trProg, GL_LINK_STATUS, &ok);
+  if (! ok)
   {
-    int mem = (memCurr - m + MAXMEM) % MAXMEM;
-
-    int fade = m;
-    if (phosphor)
-      fade = MIN((MAXPHOSPHOR - 1) / phosphor * m, MAXMEM - 1);
-
-    nPoints = 0;
-
-    for (int i = firstUsedBin; i <= lastUsedBin; i++)
-    {
-      int x = (int)(i * (squeeze ? stepRel : stepAbs) + 0.0) + xShift;
+    char log[1024];
+    glGetProgramInfoLog(trProg, sizeof(log), NULL, log);
+    ERR(O, "Shader link failed: %s", log);
+  }
 
-      int y = data[mem][i][ch];
+  // No vertex attributes, everything is fetched from buffer texture.
+  glGenVertexArrays(1, &trVao);
+  glGenBuffers(1, &trVbo);
+  glBindBuffer(GL_TEXTURE_BUFFER, trVbo);
 
-      // Currently, only one whole non-interrupted set of points. TODO
-      if ((y != NODATA) && (x >= 0) && (x <= xSize))
-      {
-        y = scalingYcoe0 - y * scalingYcoe1;
-        y = FIT(y, 0, ySize);
-        ADDPOINT(x, y);
-      }
-    }
+  int storage = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+  for (int i = 0; i < n; i++)
+    if (! strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage"))
+      storage = 1;
 
-    if (! nPoints)
-      return;
+  if (storage)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_TEXTURE_BUFFER, texels * sizeof(int16_t), NULL, flags);
+    trMap = glMapBufferRange(GL_TEXTURE_BUFFER, 0, texels * sizeof(int16_t), flags);
+  }
+  else
+    glBufferData(GL_TEXTURE_BUFFER, texels * sizeof(int16_t), NULL, GL_STREAM_DRAW);
 
-    // Now draw using same array with either X11 or openGL plot.
-    if (! optOpengl)
-    {
-      if (lineThick)
-      {
-        if (optRayFade)
-          // Effect of different brightness of long and short lines, as on real CRT.
-          for (int i = 0; i < (nPoints - 1); i++)
-          {
-            int y0 = points[i].y;
-            int y1 = points[i + 1].y;
-            XDrawLine(dpy, pm, lineColor[COLOR(ch, RAYFADE(fade, y1, y0))][lineThick-1],  points[i].x, y0, points[i + 1].x, y1);
-          }
-        else
-          XDrawLines(dpy, pm, lineColor[COLOR(ch, fade)][lineThick-1], points, nPoints, CoordModeOrigin);
-      }
+  glGenTextures(1, &trTex);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, trTex);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R16I, trVbo);
+  glActiveTexture(GL_TEXTURE0);
 
-      if (pointThick)
-      {
-        XDrawPoints(dpy, pm, lineColor[COLOR(ch, fade)][pointThick-1], points, nPoints, CoordModeOrigin);
-        // Workaround for X11 points don't use GC 'width' (bold are impossible).
-        if (pointThick > 1)
-        {
-          // Absolute to relative coords
-          for (int i = nPoints - 1; i >= 1; i--)
-          {
-            points[i].x = points[i].x - points[i - 1].x;
-            points[i].y = points[i].y - points[i - 1].y;
-          }
+  for (int u = 0; u < U_NUM; u++)
+    trUni[u] = glGetUniformLocation(trProg, trUniName[u]);
 
-          // Place extra 4 points around
-          for (int j = 0; j < 4; j++)
-          {
-            points[0].x = points[0].x + (((((j+1) % 4) / 2) * 2) - 1);
-            points[0].y = points[0].y + (((j / 2) * 2) - 1) + !(j);
-            XDrawPoints(dpy, pm, lineColor[COLOR(ch, fade)][pointThick-1], points, nPoints, CoordModePrevious);
-          }
-        }
-      }
-    }
-    else
-    {
-      glColor4ubv((void *) lineColorAbgr + COLOR(ch, fade) * 4);
-      glEnableClientState(GL_VERTEX_ARRAY);
+  glUseProgram(trProg);
+  glUniform1i(glGetUniformLocation(trProg, "traces"), 1);
+  glUseProgram(0);
 
-      if (lineThick)
-      {
-        glLineWidth((MAX(lineThick, 1) - glGpuComp) * glFont);
-        if (optRayFade)
-        {
-          // Effect of different brightness of long and short lines, as on real CRT.
-          XPoint lines[MAXDATA * 2];
-          uint32_t colors[MAXDATA * 2];
+  MSG(O, "Shader trace renderer: %s, buffer %s.", glGetString(GL_VERSION), trMap ? "persistent" : "sub-data");
+}
 
-          // Separate multiline to atomic lines 0 1 2 3 4 -> (0) 0 1, 1 2, 2 3, 3 4 (4)
-          for (int i = 0; i < nPoints; i++)
-          {
-            colors[i*2] = colors[i*2 + 1] = lineColorAbgr[COLOR(ch, RAYFADE(fade, points[i + 1].y, points[i].y))];
-            lines[i*2].x = lines[i*2 + 1].x = points[i].x;
-            lines[i*2].y = lines[i*2 + 1].y = points[i].y;
-          }
+void trDestroy(void)
+{
+  if (! trProg)
+    return;
 
-          glEnableClientState(GL_COLOR_ARRAY);
-          glVertexPointer(2, GL_SHORT, 0, &lines[1]); // Shifted a bit.
-          glColorPointer(4, GL_UNSIGNED_BYTE, 0, &colors); // Not shifted.
-          glDrawArrays(GL_LINES, 0, (nPoints - 1) * 2);
-          glDisableClientState(GL_COLOR_ARRAY);
-        }
-        else
-        {
-          glVertexPointer(2, GL_SHORT, 0, &points); // XPoint's are int16's.
-          glDrawArrays(GL_LINE_STRIP, 0, nPoints);
-        }
-      }
+  if (trFence)
+    glDeleteSync(trFence);
+  glBindBuffer(GL_TEXTURE_BUFFER, trVbo);
+  if (trMap)
+    glUnmapBuffer(GL_TEXTURE_BUFFER);
+  glDeleteTextures(1, &trTex);
+  glDeleteBuffers(1, &trVbo);
+  glDeleteVertexArrays(1, &trVao);
+  glDeleteProgram(trProg);
+}
 
-      if (pointThick)
-      {
-        glPointSize((MAX(pointThick + 1.5, 1) - glGpuComp) * glFont);
-        glVertexPointer(2, GL_SHORT, 0, &points);
-        glDrawArrays(GL_POINTS, 0, nPoints);
-      }
+// Copy valid part of shown traces. GPU may still read previous frame, so wait for it first.
+void trUpload(void)
+{
+  if (trFence)
+  {
+    glClientWaitSync(trFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000UL);
+    glDeleteSync(trFence);
+    trFence = 0;
+  }
 
-      glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_TEXTURE_BUFFER, trVbo);
+  for (int m = 0; m < shown->memQty; m++)
+  {
+    int mem = (shown->memCurr - m + MAXMEM) % MAXMEM;
+    for (int ch = 0; ch < channels; ch++)
+    {
+      trace_t *tr = &shown->trace[mem][ch];
+      if ((tr->gen != shown->gen) || (tr->lo > tr->hi))
+        continue;
+
+      uint64_t offset = (TRACE(shown->data, mem, ch) - shown->data) + tr->lo;
+      uint64_t bytes = (tr->hi - tr->lo + 1) * sizeof(int16_t);
+      if (trMap)
+        memcpy(trMap + offset, shown->data + offset, bytes);
+      else
+        glBufferSubData(GL_TEXTURE_BUFFER, offset * sizeof(int16_t), bytes, shown->data + offset);
     }
   }
 }
 
-
-// Two shape of markers: diamonds or star, depend if marker is delta.
-void plotMkr(int x, int y, int ch, int isDelta, int value, float freq)
+void trDraw(int ch, int lineThick, int pointThick)
 {
-  XImage *xim = NULL;
-  int8_t q = mkrSize;
-  int8_t p[12][4] = {{-q, 0, 0, q}, {0, q, q, 0}, {q, 0, 0, -q}, {0, -q, -q, 0},
-        {-q/2, 0, 0, q/2}, {0, q/2, q/2, 0}, {q/2, 0, 0, -q/2}, {0, -q/2, -q/2, 0},
-        {-q+1, -q+1, q-1, q-1}, {-q+1, q-1, q-1, -q+1}, {0, q, 0, -q}, {-q, 0, q, 0}};
+  int first = shown->firstUsedBin, last = shown->lastUsedBin;
+  int slots = shown->memQty;
+  if ((first < 0) || (last < first))
+    return;
 
-  if (optOpengl)
-    // Black opaque, or, Transparent.
-    XFillRectangle(dpy, pmMkr, (depth < 32) ? fontColor[9] : transparentColor, 0, 0, mkrW, mkrH);
+  GLint rowOf[MAXMEM], fadeOf[MAXMEM], range[MAXMEM][2];
+  GLfloat palette[16][4];
 
-  for (int i = 0 + isDelta * 8; i < (8 + isDelta * 4); i++)
+  // Oldest first, so fresh data is on top.
+  for (int i = 0; i < slots; i++)
   {
-    if (optOpengl)
-      // White opaque, will be key.
-      XDrawLine(dpy, pmMkr, fontColor[8], mkrW / 2 + p[i][0], mkrH / 2 + p[i][1], mkrW / 2 + p[i][2], mkrH / 2 + p[i][3]);
-    else
-      XDrawLine(dpy, pm, lineColor[ch * GRADIENTS][0], DX + x + p[i][0], DY + y + p[i][1], DX + x + p[i][2], DY + y + p[i][3]);
+    int m = slots - 1 - i;
+    int mem = (shown->memCurr - m + MAXMEM) % MAXMEM;
+    trace_t *tr = &shown->trace[mem][ch];
+    rowOf[i] = TRACE(shown->data, mem, ch) - shown->data;
+    fadeOf[i] = phosphor ? MIN((MAXPHOSPHOR - 1) / phosphor * m, MAXMEM - 1) : m;
+    range[i][0] = (tr->gen == shown->gen) ? tr->lo : 1;
+    range[i][1] = (tr->gen == shown->gen) ? tr->hi : 0;
   }
 
-  char tempStrDb[256];
-  sprintf(tempStrDb, isDelta ? "%+.3g dB" : "%.5g dB", value / (float)intDbScale);
-
-  char tempStrHz[256];
-  sprintf(tempStrHz, isDelta ? "%+g %s" : "%g %s", freq DUNITS2STR);
-
-  // Labels position change if close to top or right.
-  int mirrorX = ((xSize - x) < 80) ? -3 : -1;
-  int flipY = (y < 40) ? q - 12 : -32 - q;
-
-  if (optOpengl)
+  for (int g = 0; g < 16; g++)
+    for (int c = 0; c < 4; c++)
+      palette[g][c] = ((uint8_t *)&lineColorAbgr[COLOR(ch, g)])[c] / 255.0;
+
+  glUseProgram(trProg);
+  glBindVertexArray(trVao);
+
+  glUniform1i(trUni[U_FIRST], first);
+  glUniform1i(trUni[U_XSHIFT], xShift);
+  glUniform1i(trUni[U_XSIZE], xSize);
+  glUniform1i(trUni[U_YSIZE], ySize);
+  glUniform1iv(trUni[U_ROWOF], slots, rowOf);
+  glUniform1iv(trUni[U_FADEOF], slots, fadeOf);
+  glUniform2iv(trUni[U_RANGE], slots, &range[0][0]);
+  glUniform4fv(trUni[U_PALETTE], 16, &palette[0][0]);
+  glUniform1f(trUni[U_STEPX], squeeze ? stepRel : stepAbs);
+  glUniform1f(trUni[U_COE0], scalingYcoe0);
+  glUniform1f(trUni[U_COE1], scalingYcoe1);
+  glUniform2f(trUni[U_ORIGIN], DX, DY);
+  glUniform2f(trUni[U_VIEW], winW / glScale, winH / glScale);
+
+  if (lineThick)
   {
-    int labelW = MAX(strlen(tempStrDb), strlen(tempStrHz)) * 6;
-    int leftShift = (mirrorX < -2) ? labelW : 0;
-    int mx = mkrW / 2 + (mirrorX + 2) * q - leftShift;
-    int my = mkrH / 2 + flipY + 20;
-
-    // White opaque.
-    XDrawString (dpy, pmMkr, fontColor[8], mx, my, tempStrDb, strlen(tempStrDb));
-    XDrawString (dpy, pmMkr, fontColor[8], mx, my + vtab, tempStrHz, strlen(tempStrHz));
-
-    // For 24 bit: here is alpha also exist, but prefilled with 255, the problem is how to auto add alpha now (color keying).
-    xim = XGetImage(dpy, pmMkr, 0, 0, mkrW, mkrH, AllPlanes, ZPixmap);
-    if (! xim)
-      ERR(X, "XGetImage() failed.");
-
-    // OpenGL does not have any color keying (auto Alpha based on some color threshold).     We emulate Alpha keying using white "key" color, then do math based on it twice: for black letters outline, then for colored letters. It works good here, and we even do not need to know if we have Alpha (24 or 32 bit), except correct rectangle pre-fill above.
-    // Opaque black for text outline.
-    glBlendColor(0, 0, 0, 1.0);
-    // Replace white as key color, to blend color.
-    // glBlendFuncSeparate(), glBlendEquationSeparate() not helps much here.
-    glBlendFunc(GL_CONSTANT_COLOR, GL_ONE_MINUS_SRC_COLOR);
+    glLineWidth((MAX(lineThick, 1) - glGpuComp) * glFont);
+    glUniform1i(trUni[U_RAYFADE], optRayFade);
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, last - first + 1, slots);
   }
 
-  // Colored text over black outline.
-  for (int i = 0; i < 9; i++)
+  if (pointThick)
   {
-    int dx = (i + 2) % 3;
-    int dy = (i + 6) % 9 / 3;
+    glPointSize((MAX(pointThick + 1.5, 1) - glGpuComp) * glFont);
+    glUniform1i(trUni[U_RAYFADE], 0);
+    glDrawArraysInstanced(GL_POINTS, 0, last - first + 1, slots);
+  }
 
-    if (optOpengl)
-    {
-      if (i == 8)
-        // Will replace white as key color, now not to black, but to text color.
-        // The pity is that glBlendColor(), glClearColor() are not have 4ubv form.
-        glBlendColor(BYTE(lineColorAbgr[ch * GRADIENTS], 0) / 255.0, BYTE(lineColorAbgr[ch * GRADIENTS], 1) / 255.0, BYTE(lineColorAbgr[ch * GRADIENTS], 2) / 255.0, 1.0);
+  glBindVertexArray(0);
+  glUseProgram(0);
+}
 
-      // [20] Unlike glRasterPos2i(), this one is faster and allows negative x, y.
-      glPixelZoom(glFont, - glFont); // Turn it upside down.
-      // glWindowPos2i((DX + x + dx - mkrW / 2 - 1) * glScale, winH - (DY + y + dy - mkrH / 2 - 1) * glScale);
-      glWindowPos2i((DX + x) * glScale + (dx - mkrW / 2 - 1) * glFont,
-            winH - ((DY + y) * glScale + (dy - mkrH / 2 - 1) * glFont));
+// Software renderer, -X. Traces are drawn into client side framebuffer of plot area, with same look as X11 (colors are
+// OR'ed like GXor, ray fade, thickness), and it goes to pm as one image per frame: by MIT-SHM if X server is local,
+// by XPutImage otherwise. Markers and status lines are drawn over it as usual.
+XImage *swImg = NULL;
+XShmSegmentInfo swShm;
+int swUseShm = 0, swShmError;
+uint32_t *swFb, *swBase; // Framebuffer (image data), and plot area of pmBase
+int swX0, swY0, swW, swH, swStride;
 
-      glDrawPixels(mkrW, mkrH, GL_BGRA, GL_UNSIGNED_BYTE, (void*)(&(xim->data[0])));
-    }
-    else // Normal X11 transparent draw.
-    {
-      plotSetColors((i < 8) ? 9 : ch + 10, mirrorX);
-      plotGotoXY(DX + x + dx + (mirrorX + 2) * q , DX + y + dy + flipY);
-      plotStr(tempStrDb);
-      plotStr(tempStrHz);
-    }
-  }
-
-  if (optOpengl)
-    XDestroyImage(xim);
+int swErrorHandler(Display *d, XErrorEvent *e)
+{
+  swShmError = 1;
+  return 0;
 }
 
-void plotOneChannelMkr(int ch, int isDelta)
+void swInit(void)
 {
-  if (! isDelta)
-    valueAbsMkr = fnumAbsMkr = 0;
+  XWindowAttributes wa;
+  XGetWindowAttributes(dpy, win, &wa);
+  swX0 = DX - mkrSize;
+  swY0 = DY - mkrSize;
+  swW = xSize + mkrSize * 2 + 1;
+  swH = ySize + mkrSize * 2 + 1;
 
-  int fnum = marker[isDelta];
-  if (fnum != -1)
+  if (XShmQueryExtension(dpy))
   {
-    // For label, we need raw value...
-    int value = data[memCurr][fnum][ch];
-    if (value == NODATA)
-      return;
+    swImg = XShmCreateImage(dpy, wa.visual, wa.depth, ZPixmap, NULL, &swShm, swW, swH);
+    if (swImg)
+    {
+      swShm.shmid = shmget(IPC_PRIVATE, swImg->bytes_per_line * swH, IPC_CREAT | 0600);
+      swShm.shmaddr = (swShm.shmid < 0) ? (char *)-1 : shmat(swShm.shmid, 0, 0);
+      swShm.readOnly = False;
 
-    if (squeeze)
-      // This result is approx., screen pixel aligned. To get exact one, we'll need to un-squeeze ("zoom in", i.e. narrower span).
-      freqHz = (isDelta ? 0 : startHz) + ((fnum - fnumAbsMkr) + 1 * (startHz < 0)) * stepRel * spanHz / xSize;
-    else
-      // Here result is exact, and float (single) precision isn't enough for debug or report; while marker label limit digits, then result can be downgraded to float later.
+      swShmError = (swShm.shmaddr == (char *)-1);
+      if (swShmError)
+      {
+        WRN(X, "No shared memory for image: %s.", strerror(errno));
+      }
+      else
+      {
+        // Remote server says it has MIT-SHM, but can't attach; error comes asynchronously.
+        swImg->data = swShm.shmaddr;
+        XErrorHandler old = XSetErrorHandler(swErrorHandler);
+        XShmAttach(dpy, &swShm);
+        XSync(dpy, False);
+        XSetErrorHandler(old);
+        if (swShmError)
+          shmdt(swShm.shmaddr);
+      }
+      if (swShm.shmid >= 0)
+        shmctl(swShm.shmid, IPC_RMID, 0); // Removed when both detach.
 
-      // Both are same:
-      // freqHz = ((fnum - fnumAbsMkr) + (isDelta ? 0 : sampleNum)) * sampleRate / (double)fftSize;
-      freqHz = (fnum - fnumAbsMkr) * (double)sampleRate / (double)fftSize +
-          (isDelta ? 0 : (startHz + deltaHz));
+      if (swShmError)
+      {
+        swImg->data = NULL;
+        XDestroyImage(swImg);
+        swImg = NULL;
+      }
+      else
+        swUseShm = 1;
+    }
+  }
 
-    int x = (int)(fnum * (squeeze ? stepRel : stepAbs) + 0.0) + xShift;
-    int y = scalingYcoe0 - value * scalingYcoe1;
-    // ...But for position, we use limited one.
-    y = FIT(y, 0, ySize);
+  if (! swImg)
+  {
+    swImg = XCreateImage(dpy, wa.visual, wa.depth, ZPixmap, 0, NULL, swW, swH, 32, 0);
+    swImg->data = malloc(swImg->bytes_per_line * swH);
+  }
 
-    plotMkr(x, y, ch, isDelta, value - valueAbsMkr, freqHz);
+  if (swImg->bits_per_pixel != 32)
+    ERR(X, "Software renderer needs 32 bit pixels, X has %d.", swImg->bits_per_pixel);
 
-    valueAbsMkr = value;
-    fnumAbsMkr = fnum;
-  }
+  swFb = (uint32_t *)swImg->data;
+  swStride = swImg->bytes_per_line / 4;
+  swBase = malloc(swStride * swH * sizeof(uint32_t));
+  MSG(X, "Software renderer %dx%d, %s.", swW, swH, swUseShm ? "MIT-SHM" : "XPutImage");
 }
 
-
-void newFft(int forceClear)
+void swDestroy(void)
 {
-  if (spanHz == 0)
-    ERR(F, "spanHz == 0");
-
-// These are experimental values, they should be adjusted due to variation in CPU && GPU power for particular system for best picture && eliminate low CPU warning. Also will differ when `fftw3` vs `kfr-fft` selected.
-#define MAXFPS 50
-#define MAXRBW -4
-#define MINRBW 8
-
-  rbwLogMin = MAX((int) log2(spanHz / (float)(xSize * 2 * MAXFPS)), MAXRBW);
-  rbwLogMax = MIN(rbwLogMin + 10, MINRBW);
-
-  rbwLog = FIT(rbwLog, rbwLogMin, rbwLogMax);
-  rbw = pow(2.0, rbwLog);
+  if (! swImg)
+    return;
 
-  DBG(F, "(1) spanHz %ld, rbw %f, rbwLog %d, rbwLogMin %d, rbwLogMax %d", spanHz, rbw, rbwLog, rbwLogMin, rbwLogMax);
+  if (swUseShm)
+  {
+    XShmDetach(dpy, &swShm);
+    shmdt(swShm.shmaddr);
+    swImg->data = NULL;
+  }
+  XDestroyImage(swImg);
+  free(swBase);
+}
 
-  fftOldSizeK = fftSizeK;
+static inline void swPixel(int x, int y, uint32_t c)
+{
+  x -= swX0;
+  y -= swY0;
+  if (((unsigned)x < (unsigned)swW) && ((unsigned)y < (unsigned)swH))
+    swFb[y * swStride + x] |= c;
+}
 
-  if (! stopped)
-    fftSizeK = ceil(log2(sampleRate * xSize * 2.0 * rbw / (float)spanHz - 1.0));
+// Bresenham; wide line has second pixel across major axis, like X11 2 px line. Segment is clipped once (Liang-Barsky)
+// to framebuffer less room for that second pixel, so pixels are written without checks.
+void swLine(int x0, int y0, int x1, int y1, uint32_t c, int wide)
+{
+  x0 -= swX0;
+  x1 -= swX0;
+  y0 -= swY0;
+  y1 -= swY0;
+  int xMax = swW - 1 - wide, yMax = swH - 1 - wide;
 
-  fftSizeK = FIT(fftSizeK, MINFFTK, maxFFTK);
+  if ((MIN(x0, x1) < 0) || (MAX(x0, x1) > xMax) || (MIN(y0, y1) < 0) || (MAX(y0, y1) > yMax))
+  {
+    double t0 = 0.0, t1 = 1.0, dxf = x1 - x0, dyf = y1 - y0;
+    double p[4] = {- dxf, dxf, - dyf, dyf}, q[4] = {x0, xMax - x0, y0, yMax - y0};
+    for (int i = 0; i < 4; i++)
+      if (p[i] == 0.0)
+      {
+        if (q[i] < 0.0)
+          return;
+      }
+      else if (p[i] < 0.0)
+        t0 = fmax(t0, q[i] / p[i]);
+      else
+        t1 = fmin(t1, q[i] / p[i]);
+    if (t0 > t1)
+      return;
 
-  fftSize = 1UL << fftSizeK;
-  fftPlotTime = fftSize / (float)sampleRate;
+    // Rounding may step out by one; box is convex, so clamped ends keep all of line inside.
+    int cx0 = lround(x0 + t0 * dxf), cy0 = lround(y0 + t0 * dyf);
+    int cx1 = lround(x0 + t1 * dxf), cy1 = lround(y0 + t1 * dyf);
+    x0 = FIT(cx0, 0, xMax);
+    y0 = FIT(cy0, 0, yMax);
+    x1 = FIT(cx1, 0, xMax);
+    y1 = FIT(cy1, 0, yMax);
+  }
 
-  stepAbs = sampleRate * xSize / (float)spanHz / (float)fftSize;
+  int dx = abs(x1 - x0), sx = (x0 < x1) ? 1 : -1;
+  int dy = - abs(y1 - y0), sy = (y0 < y1) ? 1 : -1;
+  int steep = (- dy > dx);
+  int err = dx + dy;
+  int across = wide ? (steep ? 1 : swStride) : 0;
+  uint32_t *p = swFb + y0 * swStride + x0;
 
-  fftsPerSecond = framesPerSecond = 1.0 / fftPlotTime;
-  roll = 1;
-  while ((framesPerSecond < (MAXFPS / 5)) && (roll < maxRoll))
+  for (int n = MAX(dx, - dy); n >= 0; n--)
   {
-    framesPerSecond = framesPerSecond * 2.0;
-    roll = roll * 2;
+    *p |= c;
+    p[across] |= c;
+    int e2 = 2 * err;
+    if (e2 >= dy)
+    {
+      err += dy;
+      p += sx;
+    }
+    if (e2 <= dx)
+    {
+      err += dx;
+      p += sy * swStride;
+    }
   }
+}
 
-  chunkSize = fftSize * jackPorts * sample_size_4bytes / roll;
-
-  while ((stepRel < fmax(MINSTEP, stepAbs)) && (stepRel < MAXSTEP))
-    stepRel = stepRel * 2.0;
-
-  marker[0] = marker[1] = -1;
-  mkrCh[0] = mkrCh[1] = 0;
-  mkrIsDelta = 0;
-  menuPage = 0;
+// Start of frame: restore plot area from base, or OR it over old picture for unlimited phosphor.
+void swBegin(void)
+{
+  if (! baseValid)
+    baseBuild();
 
-  plotSamplesNum = (int)((float)fftSize * (float)spanHz / (float)sampleRate);
-  squeeze = (plotSamplesNum < xSize) ? 0 : 1;
+  // Server may still read previous image.
+  XSync(dpy, False);
 
-  if ((fftOldSizeK != fftSizeK) || (forceClear))
+  if (swBaseStale)
   {
-    memQty = 1;
-    rollPhase = 0;
-    discardCurrentFft = 1;
-    newScreen(! stopped);
+    XImage *b = XGetImage(dpy, pmBase, swX0, swY0, swW, swH, AllPlanes, ZPixmap);
+    if (! b)
+      ERR(X, "XGetImage() failed.");
+    for (int y = 0; y < swH; y++)
+      memcpy(swBase + y * swStride, b->data + y * b->bytes_per_line, swW * sizeof(uint32_t));
+    XDestroyImage(b);
+    swBaseStale = 0;
   }
 
-  DBG(F, "(2) sampleRate %ld, spanHz %ld, fftSize %ld", sampleRate, spanHz, fftSize);
-  DBG(F, "(3) stepAbs %f, stepRel %f, roll %ld, fftSize %ld, chunkSize %ld", stepAbs, stepRel, roll, fftSize, chunkSize);
-
-  float sampleNumF = startHz * (float)fftSize / (float)sampleRate;
-  sampleNum = (int)(sampleNumF);
-  deltaHz = (sampleNum - sampleNumF) / (float)fftSize * (float)sampleRate;
-  xShift = ceil(deltaHz * (float)xSize / (float)spanHz + 0.0);
-  DBV(F, "(4) %f %d %f %d", sampleNumF, sampleNum, deltaHz, xShift);
+  uint64_t n = swStride * swH;
+  if (phosphor < MAXPHOSPHOR)
+    memcpy(swFb, swBase, n * sizeof(uint32_t));
+  else
+    for (uint64_t i = 0; i < n; i++)
+      swFb[i] |= swBase[i];
 }
 
-
-void setCenter (int new_value)
+void swPlot(int ch, int fade, int lineThick, int pointThick)
 {
-  int centerHz = FIT(new_value, minHz, maxHz);
-  startHz = centerHz - spanHz / 2;
-  sprintf(resultStr, "Center: %g %s", centerHz DUNITS2STR);
-  newFft(0); // For sampleNum, at least.
-  newScreen(1);
-}
+  if (lineThick)
+    for (int i = 0; i < (nPoints - 1); i++)
+    {
+      int g = optRayFade ? RAYFADE(fade, points[i + 1].y, points[i].y) : fade;
+      swLine(points[i].x, points[i].y, points[i + 1].x, points[i + 1].y, lineColorPixel[COLOR(ch, g)], lineThick > 1);
+    }
 
-void setSpan (int new_value)
-{
-  int centerHz = startHz + spanHz / 2;
-  spanHz = FIT(new_value, minSpanHz, maxSpanHz);
-  startHz = centerHz - spanHz / 2;
-  newFft(1);
-  sprintf(resultStr, "Span: %g %s", spanHz DUNITS2STR);
+  if (pointThick)
+  {
+    uint32_t c = lineColorPixel[COLOR(ch, fade)];
+    for (int i = 0; i < nPoints; i++)
+    {
+      int x = points[i].x, y = points[i].y;
+      swPixel(x, y, c);
+      // Bold point is a cross, as X11 path does.
+      if (pointThick > 1)
+      {
+        swPixel(x - 1, y, c);
+        swPixel(x + 1, y, c);
+        swPixel(x, y - 1, c);
+        swPixel(x, y + 1, c);
+      }
+    }
+  }
 }
 
-// 'direction' here & after can be -1, 1, or 0 if just fit/limit
-void setRbw (int direction)
+void swPut(void)
 {
-  rbwLog = FIT(rbwLog + direction, rbwLogMin, rbwLogMax);
-  rbw = pow(2, rbwLog);
-  newFft(0);
-  sprintf(inputStr, RBW2STR);
+  if (swUseShm)
+    XShmPutImage(dpy, pm, bgColor, swImg, 0, 0, swX0, swY0, swW, swH, False);
+  else
+    XPutImage(dpy, pm, bgColor, swImg, 0, 0, swX0, swY0, swW, swH);
 }
 
-void setVbw (int direction)
+// Density display, -E. Engine turns each spectrum (each roll step too) into screen column spans of its line, and
+// passes them through a ring to display thread, which adds them to per-pixel hit counts. Hits decay exponentially
+// with spectra time, but instead of scaling whole buffer each spectrum, new hits get growing weight 2^(t / half-life),
+// and buffer is renormalized rarely. So cost is per spectrum and per pixel, not per trace kept.
+#define DENSRING 128
+typedef struct
 {
-  vbwLog = FIT(vbwLog + direction, -1, 8);
-  vbw = (vbwLog < 0) ? 0 : 1 << vbwLog;
-  sprintf(inputStr, VBW2STR);
-  newScreen(0);
-}
-
-void setYShift (int direction)
+  int16_t lo, hi; // Empty if lo > hi
+} span_t;
+#define DENSSLOT(e, ch) (densRing + ((e) * channels + (ch)) * (uint64_t)(xSize + 1))
+
+span_t *densRing = NULL;     // [DENSRING][ch][xSize + 1]
+int densGenOf[DENSRING];     // screenGen of entry
+float densDt[DENSRING];      // Seconds of signal entry stands for
+uint64_t densHead = 0;       // Entries written by engine
+
+// Display side.
+uint64_t densTail = 0, densLost = 0;
+float *densHits = NULL;      // [ch][ySize + 1][xSize + 1]
+double densLogW = 0;         // log2 of weight of new hit
+int densGenSeen = -1;
+XImage *densImg = NULL;      // X11 and openGL; software renderer draws into its own framebuffer
+GC densGc;
+GLuint densTex = 0;
+
+void densityAlloc(void)
 {
-  yDbMax = FIT(yDbMax + yDbStep * direction, -300, 100); // TODO fix limits.
-  newScreen(0);
+  if (! densRing)
+    densRing = calloc(DENSRING * channels * (xSize + 1), sizeof(span_t));
 }
 
-void instrumentReset (int cold)
+void densityPlot(void)
 {
-  if (cold)
+  int w = xSize + 1, h = ySize + 1;
+  uint64_t n = (uint64_t)w * h;
+
+  if (! densHits)
   {
-    startHz = xHzMin;
-    spanHz = xHzMax - xHzMin;
-    stepAbs = stepRel = 1.0;
-    crtRayStyle = 0;
-    for (int ch = 0; ch < MAXCH; ch++)
+    densHits = calloc(channels * n, sizeof(float));
+    if (! optShm)
     {
-      fftWindow[ch] = DEFWIN;
-      // Noise (Avg) menu is default for ENOB measurement.
-      measMode[ch] = optShowEnob;
+      XWindowAttributes wa;
+      XGetWindowAttributes(dpy, win, &wa);
+      densImg = XCreateImage(dpy, wa.visual, wa.depth, ZPixmap, 0, calloc(n, sizeof(uint32_t)), w, h, 32, w * 4);
+      if (densImg->bits_per_pixel != 32)
+        ERR(X, "Density display needs 32 bit pixels, X has %d.", densImg->bits_per_pixel);
+      densGc = XCreateGC(dpy, pm, 0, 0);
+      XSetFunction(dpy, densGc, GXor);
     }
-    stats = 0;
-    vbwLog = 0;
-    vbw = 1;
-    phosphor = defPhospor;
   }
 
-  for (int ch = 0; ch < MAXCH; ch++)
-    inminAbsNonzero[ch] = 2.0;
+  if (densGenSeen != screenGen)
+  {
+    memset(densHits, 0, channels * n * sizeof(float));
+    densLogW = 0;
+    densGenSeen = screenGen;
+  }
 
-  setSpan(spanHz); // -> newFft(1) -> memory clear
+  // Entries engine already went round the ring over are lost; engine may be writing one at head.
+  float dt = 0;
+  while (1)
+  {
+    uint64_t head = __atomic_load_n(&densHead, __ATOMIC_ACQUIRE);
+    if (densTail >= head)
+      break;
+    if (head - densTail >= DENSRING - 1)
+    {
+      densLost += head - densTail - (DENSRING / 2);
+      densTail = head - (DENSRING / 2);
+      DBG(X, "Density: %ld spectra lost so far.", densLost);
+    }
 
-  memAddScheduled = 0;
-  inputStr[0] = inputName[0] = resultStr[0] = '\0';
-  menu = 0;
-  rePlot = 0;
-}
+    int e = densTail++ % DENSRING;
+    if (densGenOf[e] != screenGen)
+      continue;
 
-void processMouse(int x, int y, int which)
-{
-  if ((x >= 0) && (x <= (xSize + 1)) && (y >= 0) && (y <= (ySize + 1)))
+    dt = densDt[e];
+    densLogW += dt * 1000.0 / densityMs;
+    if (densLogW > 64)
+    {
+      float k = exp2(- densLogW);
+      for (uint64_t i = 0; i < channels * n; i++)
+        densHits[i] *= k;
+      densLogW = 0;
+    }
+
+    float wgt = exp2(densLogW);
+    for (int ch = 0; ch < channels; ch++)
+    {
+      span_t *s = DENSSLOT(e, ch);
+      float *hits = densHits + ch * n;
+      for (int x = 0; x < w; x++)
+        for (int y = s[x].lo; y <= s[x].hi; y++)
+          hits[y * w + x] += wgt;
+    }
+  }
+
+  // Color: log of hits, relative to pixel hit by each spectrum, to 16 fade levels. One hit is shown for 6 half-lives.
+  static float full = 1;
+  if (dt > 0)
+    full = 1.0 / (1.0 - exp2(- dt * 1000.0 / densityMs));
+  float thr[16];
+  float wgt = exp2(densLogW);
+  for (int f = 0; f < 16; f++)
+    thr[f] = MAX(exp2((15 - f) / 16.0 * log2(1 + full)) - 1, 1 / 64.0) * wgt;
+
+  uint32_t *img;
+  int stride;
+  if (optShm)
   {
-    int fnum = ((x - xShift) / (squeeze ? stepRel : stepAbs) + 0.5);
-    marker[which] = FIT(fnum, firstUsedBin, lastUsedBin);
+    img = swFb + (DY - swY0) * swStride + (DX - swX0);
+    stride = swStride;
+  }
+  else
+  {
+    img = (uint32_t *)densImg->data;
+    stride = w;
+    memset(img, 0, n * sizeof(uint32_t));
   }
-}
 
-void processKeyboard (int rk)
-{
-  void inputMode (int m, char* str)
+  for (int ch = 0; ch < channels; ch++)
   {
-    menu = m;
-    strcpy(inputName, str);
-    inputStr[0] = resultStr[0] = '\0';
+    float *hits = densHits + ch * n;
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x++)
+      {
+        float v = hits[y * w + x];
+        if (v < thr[15])
+          continue;
+        int f = 15;
+        while ((f > 0) && (v >= thr[f - 1]))
+          f--;
+        img[y * stride + x] |= lineColorPixel[COLOR(ch, f)];
+      }
   }
 
-  rk = rk + 256 * menuPage;
+  if (optShm)
+    return;
 
-  DBV(X, "Menu %d Key %d (%d)", menu, rk % 256, rk);
+  if (! optOpengl)
+  {
+    XPutImage(dpy, pm, densGc, densImg, 0, 0, DX, DY, w, h);
+    return;
+  }
 
-  // Per-channel things: menuPage == 2. F1...F9
-  if ((rk >= (67 + 512)) && (rk <= (75 + 512)))
+  // Plot coordinates of phase 2 have pixel centers at integers. Blending is same as for traces.
+  if (! densTex)
   {
-    int ch = (rk - (67 + 512)); // Channel 0...7; or 8 for all channels
-    int c = ch % MAXCH; // For all (8) we take 0 as reference
-    if (c < channels)
-    {
-      // Cycle 1st param:
-      // 0: Tone (Max), 1: Noise minus window NF (Avg)
-      measMode[c] = (measMode[c] + 1) % MAXMEASMODE;
-      if (measMode[c] == 0)
-        // Cycle 2nd param:
-        fftWindow[c] = (fftWindow[c] + 1) % MAXWIN;
+    glGenTextures(1, &densTex);
+    glBindTexture(GL_TEXTURE_2D, densTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+  }
+  glBindTexture(GL_TEXTURE_2D, densTex);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_BGRA, GL_UNSIGNED_BYTE, img);
+  glEnable(GL_TEXTURE_2D);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  glBegin(GL_QUADS);
+  glTexCoord2f(0, 0); glVertex2f(DX - 0.5, DY - 0.5);
+  glTexCoord2f(1, 0); glVertex2f(DX + w - 0.5, DY - 0.5);
+  glTexCoord2f(1, 1); glVertex2f(DX + w - 0.5, DY + h - 0.5);
+  glTexCoord2f(0, 1); glVertex2f(DX - 0.5, DY + h - 0.5);
+  glEnd();
+  glDisable(GL_TEXTURE_2D);
+}
 
-      if (ch == MAXCH)
-        for (int i = 1; i < channels; i++) // Copy reference to all
-        {
-          measMode[i] = measMode[0];
-          fftWindow[i] = fftWindow[0];
-        }
+// Waterfall, -U. Pane below plot, one row per shown frame: max of all spectra engine made since last row, of marker's
+// channel, colored by level between yDbMin and yDbMax. Rows are a ring: openGL texture with GL_REPEAT, or X pixmap,
+// so new row is one row upload, and pane is one quad or two copies.
+#define WFY (DY + ySize + DX)
+int wfRows = 0;              // History depth, 0 = off
+int16_t *wfAcc;              // Engine: [ch][dataBins] max since display took row
+int wfAccGen = -1;
+int wfHead = 0;              // Newest row
+int wfGen = -1;
+uint32_t wfPalette[256];
+XImage *wfImg = NULL;        // One row
+Pixmap wfPm = 0;
+GLuint wfTex = 0;
+
+void waterfallPlot(void)
+{
+  int w = xSize + 1;
 
-      sprintf(resultStr, "Ch. %s: %s, %s", (ch < MAXCH) ? DIGIT2STR(ch) : "All", measModeStr[measMode[c]], fftWindowStr[fftWindow[c]]);
-    }
+  if (! wfImg)
+  {
+    XWindowAttributes wa;
+    XGetWindowAttributes(dpy, win, &wa);
+    wfImg = XCreateImage(dpy, wa.visual, wa.depth, ZPixmap, 0, calloc(w, sizeof(uint32_t)), w, 1, 32, w * 4);
+    if (wfImg->bits_per_pixel != 32)
+      ERR(X, "Waterfall needs 32 bit pixels, X has %d.", wfImg->bits_per_pixel);
+    // Blue to red, getting lighter; 0 is background.
+    for (int i = 0; i < 256; i++)
+      wfPalette[i] = ahsl2argb(255, 1 + (255 - i) * 170 / 255, 255, i * 180 / 255);
+    if (! optOpengl)
+      wfPm = XCreatePixmap(dpy, win, w, wfRows, wa.depth);
   }
 
-  // This numeric and some more input handle is for menuPage 0.
-  if ((menu == 1) || (menu == 2))
+  // New scales: old rows are not valid.
+  if (wfGen != screenGen)
   {
-    // 0..9 digits input, include keypad.
-    for (uint8_t i = 0; i < 20; i++)
-      if (rk == (uint16_t[20]){19, 90, 10, 87, 11, 88, 12, 89, 13, 83, 14, 84, 15, 85, 16, 79, 17, 80, 18, 81}[i])
+    if (optOpengl)
+    {
+      if (! wfTex)
       {
-        strlcat(inputStr, DIGIT2STR(i / 2), 254);
-        break;
+        glGenTextures(1, &wfTex);
+        glBindTexture(GL_TEXTURE_2D, wfTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
       }
+      void *zero = calloc(w * wfRows, sizeof(uint32_t));
+      glBindTexture(GL_TEXTURE_2D, wfTex);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, wfRows, 0, GL_BGRA, GL_UNSIGNED_BYTE, zero);
+      free(zero);
+    }
+    else
+      XFillRectangle(dpy, wfPm, bgColor, 0, 0, w, wfRows);
+    wfGen = screenGen;
+  }
 
-    // Add decimal point, if not already added.
-    if ((rk == 59) || (rk == 60) || (rk == 91)) // Both ',' or '.'
-      if (strchr(inputStr, '.') == NULL)
-        strlcat(inputStr, ".", 254);
-
-    // Backspace.
-    if (rk == 22)
-      inputStr[MAX(strlen(inputStr) - 1, 0)] = '\0';
+  // Row: max of bins in each column, as screen y, to palette.
+  uint32_t *px = (uint32_t *)wfImg->data;
+  int16_t top[w];
+  for (int x = 0; x < w; x++)
+    top[x] = ySize + 1;
 
-    // 'h', 'k', 'm' are acts as Enter, yet define entry as Hz, kHz or MHz.
+  int ch = mkrCh[0];
+  int16_t *row = shown->wf + ch * (uint64_t)dataBins;
+  for (int i = 0; i < cols; i++)
+  {
+    int x = (int)(i * (squeeze ? stepRel : stepAbs) + 0.0) + xShift;
+    if ((row[i] == NODATA) || (x < 0) || (x > xSize))
+      continue;
+    int y = scalingYcoe0 - row[i] * scalingYcoe1;
+    top[x] = MIN(top[x], FIT(y, 0, ySize));
+  }
+  for (int x = 0; x < w; x++)
+    px[x] = (top[x] > ySize) ? wfPalette[0] : wfPalette[MAX(255 - top[x] * 255 / ySize, 1)];
+
+  wfHead = (wfHead - 1 + wfRows) % wfRows;
+
+  if (optOpengl)
+  {
+    // Texture T wraps, so quad starts at newest row.
+    float t0 = wfHead / (float)wfRows;
+    glBindTexture(GL_TEXTURE_2D, wfTex);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, wfHead, w, 1, GL_BGRA, GL_UNSIGNED_BYTE, px);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, t0);     glVertex2f(DX - 0.5, WFY - 0.5);
+    glTexCoord2f(1, t0);     glVertex2f(DX + w - 0.5, WFY - 0.5);
+    glTexCoord2f(1, t0 + 1); glVertex2f(DX + w - 0.5, WFY + wfRows - 0.5);
+    glTexCoord2f(0, t0 + 1); glVertex2f(DX - 0.5, WFY + wfRows - 0.5);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+  }
+  else
+  {
+    XPutImage(dpy, wfPm, bgColor, wfImg, 0, 0, 0, wfHead, w, 1);
+    XCopyArea(dpy, wfPm, pm, bgColor, 0, wfHead, w, wfRows - wfHead, DX, WFY);
+    XCopyArea(dpy, wfPm, pm, bgColor, 0, 0, w, wfHead, DX, WFY + wfRows - wfHead);
+    XFlushArea(DX, WFY, w, wfRows);
+  }
+}
+
+
+void plotOneChannel(int ch)
+{
+  int pointThick = crtRayStyle % 3;
+  int lineThick  = crtRayStyle / 3;
+  if (! crtRayStyle) { // Auto
+    pointThick = stepAbs > 4 ? 2 : 0;
+    lineThick = 1;
+  }
+
+  if (optGlCore)
+  {
+    trDraw(ch, lineThick, pointThick);
+    return;
+  }
+
+  // Draw from last to 1st to make fresh data on top. 0 = actual, 1-... = memory
+  for (int m = shown->memQty - 1; m >= 0; m--)
+  {
+    int mem = (shown->memCurr - m + MAXMEM) % MAXMEM;
+
+    int fade = m;
+    if (phosphor)
+      fade = MIN((MAXPHOSPHOR - 1) / phosphor * m, MAXMEM - 1);
+
+    nPoints = 0;
+
+    trace_t *tr = &shown->trace[mem][ch];
+    int16_t *row = TRACE(shown->data, mem, ch);
+    int first = (tr->gen == shown->gen) ? MAX(shown->firstUsedBin, tr->lo) : 1;
+    int last = (tr->gen == shown->gen) ? MIN(shown->lastUsedBin, tr->hi) : 0;
+
+    for (int i = first; i <= last; i++)
+    {
+      int x = (int)(i * (squeeze ? stepRel : stepAbs) + 0.0) + xShift;
+
+      int y = row[i];
+
+      // Currently, only one whole non-interrupted set of points. TODO
+      if ((y != NODATA) && (x >= 0) && (x <= xSize))
+      {
+        y = scalingYcoe0 - y * scalingYcoe1;
+        y = FIT(y, 0, ySize);
+        ADDPOINT(x, y);
+      }
+    }
+
+    if (! nPoints)
+      return;
+
+    // Now draw using same array with either software, X11 or openGL plot.
+    if (optShm)
+      swPlot(ch, fade, lineThick, pointThick);
+    else if (! optOpengl)
+    {
+      if (lineThick)
+      {
+        if (optRayFade)
+          // Effect of different brightness of long and short lines, as on real CRT.
+          for (int i = 0; i < (nPoints - 1); i++)
+          {
+            int y0 = points[i].y;
+            int y1 = points[i + 1].y;
+            XDrawLine(dpy, pm, lineColor[COLOR(ch, RAYFADE(fade, y1, y0))][lineThick-1],  points[i].x, y0, points[i + 1].x, y1);
+          }
+        else
+          XDrawLines(dpy, pm, lineColor[COLOR(ch, fade)][lineThick-1], points, nPoints, CoordModeOrigin);
+      }
+
+      if (pointThick)
+      {
+        XDrawPoints(dpy, pm, lineColor[COLOR(ch, fade)][pointThick-1], points, nPoints, CoordModeOrigin);
+        // Workaround for X11 points don't use GC 'width' (bold are impossible).
+        if (pointThick > 1)
+        {
+          // Absolute to relative coords
+          for (int i = nPoints - 1; i >= 1; i--)
+          {
+            points[i].x = points[i].x - points[i - 1].x;
+            points[i].y = points[i].y - points[i - 1].y;
+          }
+
+          // Place extra 4 points around
+          for (int j = 0; j < 4; j++)
+          {
+            points[0].x = points[0].x + (((((j+1) % 4) / 2) * 2) - 1);
+            points[0].y = points[0].y + (((j / 2) * 2) - 1) + !(j);
+            XDrawPoints(dpy, pm, lineColor[COLOR(ch, fade)][pointThick-1], points, nPoints, CoordModePrevious);
+          }
+        }
+      }
+    }
+    else
+    {
+      glColor4ubv((void *) lineColorAbgr + COLOR(ch, fade) * 4);
+      glEnableClientState(GL_VERTEX_ARRAY);
+
+      if (lineThick)
+      {
+        glLineWidth((MAX(lineThick, 1) - glGpuComp) * glFont);
+        if (optRayFade)
+        {
+          // Effect of different brightness of long and short lines, as on real CRT.
+          XPoint lines[MAXDATA * 2];
+          uint32_t colors[MAXDATA * 2];
+
+          // Separate multiline to atomic lines 0 1 2 3 4 -> (0) 0 1, 1 2, 2 3, 3 4 (4)
+          for (int i = 0; i < nPoints; i++)
+          {
+            colors[i*2] = colors[i*2 + 1] = lineColorAbgr[COLOR(ch, RAYFADE(fade, points[i + 1].y, points[i].y))];
+            lines[i*2].x = lines[i*2 + 1].x = points[i].x;
+            lines[i*2].y = lines[i*2 + 1].y = points[i].y;
+          }
+
+          glEnableClientState(GL_COLOR_ARRAY);
+          glVertexPointer(2, GL_SHORT, 0, &lines[1]); // Shifted a bit.
+          glColorPointer(4, GL_UNSIGNED_BYTE, 0, &colors); // Not shifted.
+          glDrawArrays(GL_LINES, 0, (nPoints - 1) * 2);
+          glDisableClientState(GL_COLOR_ARRAY);
+        }
+        else
+        {
+          glVertexPointer(2, GL_SHORT, 0, &points); // XPoint's are int16's.
+          glDrawArrays(GL_LINE_STRIP, 0, nPoints);
+        }
+      }
+
+      if (pointThick)
+      {
+        glPointSize((MAX(pointThick + 1.5, 1) - glGpuComp) * glFont);
+        glVertexPointer(2, GL_SHORT, 0, &points);
+        glDrawArrays(GL_POINTS, 0, nPoints);
+      }
+
+      glDisableClientState(GL_VERTEX_ARRAY);
+    }
+  }
+}
+
+
+// Glyph atlas of 'fixed' font, chars 32...126, with black outline baked in. Cell has 1 px margin for outline.
+// X11: glyphs and outlines are 1-bit pixmaps; marker label is composed of them once per text change, then drawn
+// with two masked fills. openGL: one texture, white glyph in opaque black outline, and label is one quads draw.
+#define ATLASCHARS 95
+#define CELLW (glyphW + 2)
+#define CELLH (glyphH + 2)
+#define LABELCHARS 32
+Pixmap atlasGlyph, atlasOutline;
+GC atlasGc; // 1-bit
+GLuint atlasTex = 0;
+
+// Per marker (abs, delta): label masks and text they were made for.
+Pixmap labelGlyph[2], labelOutline[2];
+char labelKey[2][2 * LABELCHARS + 8];
+
+void atlasBuild(void)
+{
+  int w = ATLASCHARS * CELLW;
+  atlasGlyph = XCreatePixmap(dpy, win, w, CELLH, 1);
+  atlasOutline = XCreatePixmap(dpy, win, w, CELLH, 1);
+  atlasGc = XCreateGC(dpy, atlasGlyph, 0, NULL);
+  XSetFont(dpy, atlasGc, xfont->fid);
+
+  XSetForeground(dpy, atlasGc, 0);
+  XFillRectangle(dpy, atlasGlyph, atlasGc, 0, 0, w, CELLH);
+  XFillRectangle(dpy, atlasOutline, atlasGc, 0, 0, w, CELLH);
+  XSetForeground(dpy, atlasGc, 1);
+  for (int c = 0; c < ATLASCHARS; c++)
+    XDrawString(dpy, atlasGlyph, atlasGc, c * CELLW + 1, 1 + glyphH - 2, (char[1]){(char)(c + 32)}, 1);
+
+  // Outline is glyph, dilated by 1 px.
+  XSetFunction(dpy, atlasGc, GXor);
+  for (int i = 0; i < 9; i++)
+    XCopyArea(dpy, atlasGlyph, atlasOutline, atlasGc, 0, 0, w, CELLH, i % 3 - 1, i / 3 - 1);
+
+  for (int k = 0; k < 2; k++)
+  {
+    labelGlyph[k] = XCreatePixmap(dpy, win, LABELCHARS * glyphW + 2, vtab + CELLH, 1);
+    labelOutline[k] = XCreatePixmap(dpy, win, LABELCHARS * glyphW + 2, vtab + CELLH, 1);
+  }
+}
+
+// openGL texture of atlas, made in render thread, which owns GL context.
+void atlasTexture(void)
+{
+  int w = ATLASCHARS * CELLW;
+  XImage *g = XGetImage(dpy, atlasGlyph, 0, 0, w, CELLH, 1, XYPixmap);
+  XImage *o = XGetImage(dpy, atlasOutline, 0, 0, w, CELLH, 1, XYPixmap);
+  if ((! g) || (! o))
+    ERR(X, "XGetImage() failed.");
+
+  uint32_t *rgba = malloc(w * CELLH * sizeof(uint32_t));
+  for (int y = 0; y < CELLH; y++)
+    for (int x = 0; x < w; x++)
+      rgba[y * w + x] = (XGetPixel(g, x, y) ? 0x00ffffff : 0) | (XGetPixel(o, x, y) ? 0xff000000 : 0);
+  XDestroyImage(g);
+  XDestroyImage(o);
+
+  glGenTextures(1, &atlasTex);
+  glBindTexture(GL_TEXTURE_2D, atlasTex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, CELLH, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+  free(rgba);
+}
+
+// Two shape of markers: diamonds or star, depend if marker is delta.
+void plotMkr(int x, int y, int ch, int isDelta, int value, float freq)
+{
+  int8_t q = mkrSize;
+  int8_t p[12][4] = {{-q, 0, 0, q}, {0, q, q, 0}, {q, 0, 0, -q}, {0, -q, -q, 0},
+        {-q/2, 0, 0, q/2}, {0, q/2, q/2, 0}, {q/2, 0, 0, -q/2}, {0, -q/2, -q/2, 0},
+        {-q+1, -q+1, q-1, q-1}, {-q+1, q-1, q-1, -q+1}, {0, q, 0, -q}, {-q, 0, q, 0}};
+
+  char tempStrDb[256];
+  sprintf(tempStrDb, isDelta ? "%+.3g dB" : "%.5g dB", value / (float)intDbScale);
+
+  char tempStrHz[256];
+  sprintf(tempStrHz, isDelta ? "%+g %s" : "%g %s", freq DUNITS2STR);
+
+  char *lines[2] = {tempStrDb, tempStrHz};
+  tempStrDb[LABELCHARS] = tempStrHz[LABELCHARS] = '\0';
+
+  // Labels position change if close to top or right; lines are right aligned then.
+  int mirrored = ((xSize - x) < 80);
+  int flipY = (y < 40) ? q - 12 : -32 - q;
+  // Label mask origin, relative to marker.
+  int lx = mirrored ? -q - LABELCHARS * glyphW : q;
+  int ly = flipY + 8;
+  int lw = LABELCHARS * glyphW + 2;
+  int lh = vtab + CELLH;
+
+  char key[sizeof(labelKey[0])];
+  snprintf(key, sizeof(key), "%d|%.32s|%.32s", mirrored, tempStrDb, tempStrHz); // LABELCHARS
+  int rebuild = strcmp(key, labelKey[isDelta]);
+  if (rebuild)
+    strcpy(labelKey[isDelta], key);
+
+  if (! optOpengl)
+  {
+    for (int i = 0 + isDelta * 8; i < (8 + isDelta * 4); i++)
+      XDrawLine(dpy, pm, lineColor[ch * GRADIENTS][0], DX + x + p[i][0], DY + y + p[i][1], DX + x + p[i][2], DY + y + p[i][3]);
+
+    // Compose label masks of atlas cells, only when text was changed.
+    if (rebuild)
+    {
+      XSetFunction(dpy, atlasGc, GXcopy);
+      XSetForeground(dpy, atlasGc, 0);
+      XFillRectangle(dpy, labelGlyph[isDelta], atlasGc, 0, 0, lw, lh);
+      XFillRectangle(dpy, labelOutline[isDelta], atlasGc, 0, 0, lw, lh);
+      XSetFunction(dpy, atlasGc, GXor); // Cells overlap by margins.
+      for (int l = 0; l < 2; l++)
+      {
+        int len = strlen(lines[l]);
+        for (int n = 0; n < len; n++)
+        {
+          int c = lines[l][n] - 32;
+          if ((c < 0) || (c >= ATLASCHARS))
+            continue;
+          int mx = (mirrored ? (LABELCHARS - len) * glyphW : 0) + n * glyphW;
+          XCopyArea(dpy, atlasGlyph, labelGlyph[isDelta], atlasGc, c * CELLW, 0, CELLW, CELLH, mx, l * vtab);
+          XCopyArea(dpy, atlasOutline, labelOutline[isDelta], atlasGc, c * CELLW, 0, CELLW, CELLH, mx, l * vtab);
+        }
+      }
+    }
+
+    // Black outline, then colored text over it: two masked fills.
+    GC gc[2] = {fontColor[9], lineColor[ch * GRADIENTS][0]};
+    Pixmap mask[2] = {labelOutline[isDelta], labelGlyph[isDelta]};
+    for (int i = 0; i < 2; i++)
+    {
+      XSetClipMask(dpy, gc[i], mask[i]);
+      XSetClipOrigin(dpy, gc[i], DX + x + lx, DY + y + ly);
+      XFillRectangle(dpy, pm, gc[i], DX + x + lx, DY + y + ly, lw, lh);
+      XSetClipMask(dpy, gc[i], None);
+    }
+  }
+  else
+  {
+    if (! atlasTex)
+      atlasTexture();
+
+    // Marker in window coords, y is up; marker itself is scaled by glFont.
+    float sc = glFont;
+    float ox = (DX + x) * glScale;
+    float oy = winH - (DY + y) * glScale;
+    uint8_t *rgb = (uint8_t *)&lineColorAbgr[ch * GRADIENTS];
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Shape: black outline, then colored.
+    for (int pass = 0; pass < 2; pass++)
+    {
+      glLineWidth((pass ? 1 : 3) * sc);
+      glColor4ub(pass ? rgb[0] : 0, pass ? rgb[1] : 0, pass ? rgb[2] : 0, 255);
+      glBegin(GL_LINES);
+      for (int i = 0 + isDelta * 8; i < (8 + isDelta * 4); i++)
+      {
+        glVertex2f(ox + p[i][0] * sc, oy - p[i][1] * sc);
+        glVertex2f(ox + p[i][2] * sc, oy - p[i][3] * sc);
+      }
+      glEnd();
+    }
+
+    // Label: atlas texels are white glyph in black outline, so modulation by ray color paints glyph only.
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, atlasTex);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glColor4ub(rgb[0], rgb[1], rgb[2], 255);
+    glBegin(GL_QUADS);
+    for (int l = 0; l < 2; l++)
+    {
+      int len = strlen(lines[l]);
+      for (int n = 0; n < len; n++)
+      {
+        int c = lines[l][n] - 32;
+        if ((c < 0) || (c >= ATLASCHARS))
+          continue;
+        float cx = ox + (lx + (mirrored ? (LABELCHARS - len) * glyphW : 0) + n * glyphW) * sc;
+        float cy = oy - (ly + l * vtab) * sc;
+        float u0 = c / (float)ATLASCHARS, u1 = (c + 1) / (float)ATLASCHARS;
+        glTexCoord2f(u0, 0); glVertex2f(cx, cy);
+        glTexCoord2f(u1, 0); glVertex2f(cx + CELLW * sc, cy);
+        glTexCoord2f(u1, 1); glVertex2f(cx + CELLW * sc, cy - CELLH * sc);
+        glTexCoord2f(u0, 1); glVertex2f(cx, cy - CELLH * sc);
+      }
+    }
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+  }
+}
+
+void plotOneChannelMkr(int ch, int isDelta)
+{
+  if (! isDelta)
+    valueAbsMkr = fnumAbsMkr = 0;
+
+  int fnum = marker[isDelta];
+  if (fnum != -1)
+  {
+    // For label, we need raw value...
+    trace_t *tr = &shown->trace[shown->memCurr][ch];
+    if ((tr->gen != shown->gen) || (fnum < tr->lo) || (fnum > tr->hi))
+      return;
+    int value = TRACE(shown->data, shown->memCurr, ch)[fnum];
+    if (value == NODATA)
+      return;
+
+    if (squeeze)
+      // This result is approx., screen pixel aligned. To get exact one, we'll need to un-squeeze ("zoom in", i.e. narrower span).
+      freqHz = (isDelta ? 0 : startHz) + ((fnum - fnumAbsMkr) + 1 * (startHz < 0)) * stepRel * spanHz / xSize;
+    else
+      // Here result is exact, and float (single) precision isn't enough for debug or report; while marker label limit digits, then result can be downgraded to float later.
+
+      // Both are same:
+      // freqHz = ((fnum - fnumAbsMkr) + (isDelta ? 0 : sampleNum)) * sampleRate / (double)fftSize;
+      freqHz = (fnum - fnumAbsMkr) * fsFft / (double)fftSize +
+          (isDelta ? 0 : (startHz + deltaHz));
+
+    int x = (int)(fnum * (squeeze ? stepRel : stepAbs) + 0.0) + xShift;
+    int y = scalingYcoe0 - value * scalingYcoe1;
+    // ...But for position, we use limited one.
+    y = FIT(y, 0, ySize);
+
+    plotMkr(x, y, ch, isDelta, value - valueAbsMkr, freqHz);
+
+    valueAbsMkr = value;
+    fnumAbsMkr = fnum;
+  }
+}
+
+
+// FFT plans and window tables are built on demand by planner thread, so startup does not wait for all sizes.
+// Plan p is used by engine only after planReady[p] is set. Neighbour sizes of wanted one are prebuilt at background.
+// fftw3 planner is not thread safe, so it is called only from here (and from cleanup, after join); fftw_execute is.
+void windowfunc_calc(int p, int w, uint64_t size);
+
+pthread_t plan_thread_id;
+pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t plan_wake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t plan_done = PTHREAD_COND_INITIALIZER;
+volatile int planReady[MAXPLANS];
+uint32_t planQueue = 0; // Bits of plans to build
+int planUrgent = -1;    // Wanted plan, it and nearest to it are built first
+int planExit = 0;
+unsigned planFlags;
+uint64_t tmpNeed[MAXPLANS], tmpSize = 0; // kfr temp buffer sizes
+
+// Windows set by all channels.
+int windowsUsed(void)
+{
+  int used = 0;
+  for (int ch = 0; ch < channels; ch++)
+    used |= 1 << (fftWindow[ch] % MAXWIN);
+  return used;
+}
+
+// Build windows in use for plan p, if not yet. Planner thread calls it for plan it builds; later only
+// display thread does, when newFft() selects ready plan or channel window changes; engine waits on state lock then.
+void windowsEnsure(int p)
+{
+  uint64_t size = 1UL << (MINFFTK + p);
+  int used = windowsUsed();
+
+  for (int w = 0; w < MAXWIN; w++)
+    if ((used & (1 << w)) && (! windowfunc[p][w]) && (! windowfuncF[p][w]))
+    {
+      // Looks like, it works fine for both fftw3 and kfrlib.
+      uint64_t bytes = size / 2 * (optWinFloat ? sizeof(float) : sizeof(double));
+      if (optWinFloat)
+        windowfuncF[p][w] = fftw_malloc(bytes);
+      else
+        windowfunc[p][w] = fftw_alloc_real(size / 2);
+
+      windowfunc_calc(p, w, size);
+      __atomic_fetch_add(&windowBytes, bytes, __ATOMIC_RELAXED);
+      DBG(F, "Window %s for %ld points built, tables use %.1f MB.", fftWindowStr[w], size, windowBytes / 1e6);
+    }
+}
+
+void planBuild(int p)
+{
+  uint64_t size = 1UL << (MINFFTK + p);
+  int n = size; // should be < INT_MAX
+
+  // Zoomed input is complex and not batched: kfr complex plans are unused for real input otherwise, so they are taken
+  // for it; fftw gets its own. Zoomed real input FFT is one size less, see newFft().
+  int zoomCplx = optZoom && (optIQ || (p < plans - 1));
+
+  if (KFR && SINGLE)
+    if (optIQ)
+    {
+      plan_kfr_f32[p] = kfr_dft_create_plan_f32(size);
+      tmpNeed[p] = kfr_dft_get_temp_size_f32(plan_kfr_f32[p]);
+    }
+    else
+    {
+      plan_kfr_real_f32[p] = kfr_dft_real_create_plan_f32(size, 1); // KFR_PACK_CCS
+      tmpNeed[p] = kfr_dft_real_get_temp_size_f32(plan_kfr_real_f32[p]);
+      if (zoomCplx)
+      {
+        plan_kfr_f32[p] = kfr_dft_create_plan_f32(size);
+        tmpNeed[p] = MAX(tmpNeed[p], kfr_dft_get_temp_size_f32(plan_kfr_f32[p]));
+      }
+    }
+  else if KFR
+    if (optIQ)
+    {
+      plan_kfr[p] = kfr_dft_create_plan_f64(size);
+      tmpNeed[p] = kfr_dft_get_temp_size_f64(plan_kfr[p]);
+    }
+    else
+    {
+      plan_kfr_real[p] = kfr_dft_real_create_plan_f64(size, 1); // KFR_PACK_CCS
+      tmpNeed[p] = kfr_dft_real_get_temp_size_f64(plan_kfr_real[p]);
+      if (zoomCplx)
+      {
+        plan_kfr[p] = kfr_dft_create_plan_f64(size);
+        tmpNeed[p] = MAX(tmpNeed[p], kfr_dft_get_temp_size_f64(plan_kfr[p]));
+      }
+    }
+  else
+  {
+    // Estimate does not touch arrays, so engine ones are fine. Measuring overwrites them, so it runs on scratch arrays.
+    // Engine uses new-array execute anyway, fftw_alloc'ed arrays have same alignment.
+    void *in = fftin[0];
+    void *out = fftout[0];
+    int scratch = ! (planFlags & FFTW_ESTIMATE);
+
+    if (scratch)
+    {
+      in = fftw_malloc((optBatch ? batchInDist * channels : size) * 2 * realSize);
+      out = fftw_malloc((optBatch ? batchOutDist * channels : size) * 2 * realSize);
+    }
+
+    if (SINGLE)
+      if (optBatch)
+        if (optIQ)
+          plan_batchf[p] = fftwf_plan_many_dft(1, &n, channels, in, NULL, 1, batchInDist, out, NULL, 1, batchOutDist, -1, planFlags);
+        else
+          plan_batchf[p] = fftwf_plan_many_dft_r2c(1, &n, channels, in, NULL, 1, batchInDist, out, NULL, 1, batchOutDist, planFlags);
+      else
+        if (optIQ)
+          plan_fftwf[p] = fftwf_plan_dft_1d(n, in, out, -1, planFlags);
+        else
+          plan_fftwf[p] = fftwf_plan_dft_r2c_1d(n, in, out, planFlags);
+    else if (optBatch)
+      if (optIQ)
+        plan_batch[p] = fftw_plan_many_dft(1, &n, channels, in, NULL, 1, batchInDist, out, NULL, 1, batchOutDist, -1, planFlags);
+      else
+        plan_batch[p] = fftw_plan_many_dft_r2c(1, &n, channels, in, NULL, 1, batchInDist, out, NULL, 1, batchOutDist, planFlags);
+    else
+      if (optIQ)
+        plan_fftw[p] = fftw_plan_dft_1d(n, in, out, -1, planFlags);
+      else
+        plan_fftw[p] = fftw_plan_dft_r2c_1d(n, in, out, planFlags);
+
+    if (zoomCplx)
+    {
+      if (SINGLE)
+        plan_fftwzf[p] = fftwf_plan_dft_1d(n, in, out, -1, planFlags);
+      else
+        plan_fftwz[p] = fftw_plan_dft_1d(n, in, out, -1, planFlags);
+    }
+
+    if (scratch)
+    {
+      fftw_free(in);
+      fftw_free(out);
+    }
+  }
+
+  windowsEnsure(p);
+}
+
+// Queued plan nearest to wanted one.
+int planNext(void)
+{
+  int best = -1;
+  for (int p = 0; p < plans; p++)
+    if ((planQueue & (1U << p)) && ((best < 0) || (abs(p - planUrgent) < abs(best - planUrgent))))
+      best = p;
+  return best;
+}
+
+static void *
+plan_thread (void *arg)
+{
+  traceTid = 3;
+
+  pthread_mutex_lock (&plan_lock);
+  while (1)
+  {
+    while ((! planQueue) && (! planExit))
+      pthread_cond_wait (&plan_wake, &plan_lock);
+    if (planExit)
+      break;
+    int p = planNext();
+    pthread_mutex_unlock (&plan_lock);
+
+    uint64_t t = nsNow();
+    planBuild(p);
+    DBG(F, "Plan and windows for %ld points built in %.1f ms.", 1UL << (MINFFTK + p), (nsNow() - t) / 1e6);
+
+    pthread_mutex_lock (&plan_lock);
+    planQueue &= ~(1U << p);
+    planReady[p] = 1;
+    pthread_cond_broadcast (&plan_done);
+  }
+  pthread_mutex_unlock (&plan_lock);
+
+  return 0;
+}
+
+void planStop(void)
+{
+  if (! plan_thread_id)
+    return;
+
+  pthread_mutex_lock (&plan_lock);
+  planExit = 1;
+  pthread_cond_signal (&plan_wake);
+  pthread_mutex_unlock (&plan_lock);
+  pthread_join (plan_thread_id, NULL);
+  plan_thread_id = 0;
+}
+
+// Queue wanted size and its neighbours, return nearest ready size, not above kmax. Waits only when nothing is ready yet (startup).
+uint64_t planSelect(uint64_t k, uint64_t kmax)
+{
+  int want = k - MINFFTK;
+  int top = MIN(kmax - MINFFTK + 1, plans);
+  int best = -1;
+
+  pthread_mutex_lock (&plan_lock);
+  for (int p = MAX(want - 1, 0); p <= MIN(want + 1, top - 1); p++)
+    if (! planReady[p])
+      planQueue |= 1U << p;
+  planUrgent = want;
+  pthread_cond_signal (&plan_wake);
+
+  while (best < 0)
+  {
+    for (int d = 0; (d < plans) && (best < 0); d++)
+      if ((want - d >= 0) && (planReady[want - d]))
+        best = want - d;
+      else if ((want + d < top) && (planReady[want + d]))
+        best = want + d;
+
+    if (best < 0)
+      pthread_cond_wait (&plan_done, &plan_lock);
+  }
+  pthread_mutex_unlock (&plan_lock);
+
+  if (best != want)
+    DBG(F, "FFT %ld is not ready yet, %ld is used meanwhile.", 1UL << k, 1UL << (MINFFTK + best));
+
+  return MINFFTK + best;
+}
+
+// Wanted size is built now, and we still use other one.
+int planUpgradePending(void)
+{
+  return (! stopped) && (fftWantK != fftSizeK) && (planReady[fftWantK - MINFFTK]);
+}
+
+// Grow kfr temp buffers of all workers, if plan needs more. Workers are idle here.
+void tmpGrow(uint64_t size)
+{
+  if (size <= tmpSize)
+    return;
+
+  for (int w = 0; w < workers; w++)
+  {
+    if (tmp[w])
+      kfr_deallocate(tmp[w]);
+    tmp[w] = (uint8_t*)kfr_allocate(size);
+  }
+  tmpSize = size;
+  DBG(F, "Kfr tmp allocated %d x %ld bytes.", workers, tmpSize);
+}
+
+
+// Column boundaries for Stage 3, for current plotSamplesNum, stepAbs and stepRel.
+void columnsCalc(void)
+{
+  int sample;
+  cols = 0;
+  for (sample = 0; sample <= (plotSamplesNum + 1); sample++)
+  {
+    int bin = squeeze ? (int)(sample * stepAbs / stepRel) : sample;
+    if (bin >= dataBins)
+      break;
+    while (cols <= bin)
+      colStart[cols++] = sample;
+  }
+  colStart[cols] = sample;
+}
+
+
+// These are experimental values, they should be adjusted due to variation in CPU && GPU power for particular system for best picture && eliminate low CPU warning. Also will differ when `fftw3` vs `kfr-fft` selected.
+// With -a, max FPS and largest FFT come from measured cost instead, see autocal().
+#define MAXFPS 50
+#define MAXRBW -4
+#define MINRBW 8
+int calShare = 0;          // Target CPU share, %; 0: no calibration
+double calCps[MAXPLANS];   // ns per sample of all channels, Stages 1...3, one worker, per FFT size
+int calPar = 1;            // Workers that share that cost
+int maxFps = MAXFPS;
+int calKmax = 0;           // Largest affordable FFT, k
+
+// Roll r of FFT 2^k at fs is within CPU share.
+int calAffords(int k, double fs, uint64_t r)
+{
+  return (! calShare) || (calCps[k - MINFFTK] * fs * r <= calShare * 1e7 * calPar);
+}
+
+void newFft(int forceClear)
+{
+  if (spanHz == 0)
+    ERR(F, "spanHz == 0");
+
+  rbwLogMin = MAX((int) log2(spanHz / (float)(xSize * 2 * maxFps)), MAXRBW);
+  rbwLogMax = MIN(rbwLogMin + 10, MINRBW);
+  if (calKmax)
+    rbwLogMax = MAX(MIN(rbwLogMax, (int)floor(log2((1UL << calKmax) * spanHz / (sampleRate * xSize * 2.0)))), rbwLogMin);
+
+  rbwLog = FIT(rbwLog, rbwLogMin, rbwLogMax);
+  rbw = pow(2.0, rbwLog);
+
+  DBG(F, "(1) spanHz %ld, rbw %f, rbwLog %d, rbwLogMin %d, rbwLogMax %d", spanHz, rbw, rbwLog, rbwLogMin, rbwLogMax);
+
+  fftOldSizeK = fftSizeK;
+
+  if (! stopped)
+  {
+    int k = ceil(log2(sampleRate * xSize * 2.0 * rbw / (float)spanHz - 1.0));
+    int z = 0;
+    // Zoom: band should fit into 0.8 of decimated Nyquist band (half-band filters passband), and FFT should not go below MINFFTK.
+    if (optZoom)
+      while ((z < MAXZOOM) && (spanHz <= 0.8 * sampleRate / (2 << z)) && (k - (z + 1) >= MINFFTK))
+        z++;
+    double centerHz = z ? startHz + spanHz / 2.0 : 0;
+    if ((z != zoomStages) || (centerHz != zoomHz))
+      zoomGen++;
+    zoomStages = z;
+    zoomD = 1 << z;
+    zoomHz = centerHz;
+
+    // Zoomed real input becomes complex, it should fit into real input buffers.
+    int kmax = maxFFTK - ((z > 0) && (! optIQ));
+    fftWantK = FIT(k - z, MINFFTK, kmax);
+
+    // Zoomed FFT takes zoomD times more input, and its chunk should fit into buffers with roll that -r and CPU share
+    // allow; else FFT is smaller.
+    while ((z) && (fftWantK > MINFFTK))
+    {
+      uint64_t r = 1;
+      while ((1UL << fftWantK) * zoomD / r > (1UL << maxFFTK) / 2)
+        r = r * 2;
+      if ((r <= maxRoll) && (calAffords(fftWantK, sampleRate / (double)zoomD, r)))
+        break;
+      fftWantK--;
+    }
+
+    fftSizeK = planSelect(fftWantK, kmax);
+    windowsEnsure(fftSizeK - MINFFTK);
+  }
+
+  fsFft = sampleRate / (double)zoomD;
+  fftSize = 1UL << fftSizeK;
+  fftPlotTime = fftSize / fsFft;
+
+  stepAbs = fsFft * xSize / (float)spanHz / (float)fftSize;
+
+  fftsPerSecond = framesPerSecond = 1.0 / fftPlotTime;
+  roll = 1;
+  while ((framesPerSecond < (maxFps / 5)) && (roll < maxRoll) && (calAffords(fftSizeK, fsFft, roll * 2)))
+  {
+    framesPerSecond = framesPerSecond * 2.0;
+    roll = roll * 2;
+  }
+
+  // Chunk must fit into buffers. Wanted FFT fits within limits (see above), but ready one, until wanted is built, may
+  // be larger.
+  while (fftSize * zoomD / roll > (1UL << maxFFTK) / 2)
+    roll = roll * 2;
+
+  chunkSize = fftSize * zoomD * jackPorts * sample_size_4bytes / roll;
+
+  while ((stepRel < fmax(MINSTEP, stepAbs)) && (stepRel < MAXSTEP))
+    stepRel = stepRel * 2.0;
+
+  marker[0] = marker[1] = -1;
+  mkrCh[0] = mkrCh[1] = 0;
+  mkrIsDelta = 0;
+  menuPage = 0;
+
+  plotSamplesNum = (int)((float)fftSize * (float)spanHz / fsFft);
+  squeeze = (plotSamplesNum < xSize) ? 0 : 1;
+
+  if ((fftOldSizeK != fftSizeK) || (forceClear))
+  {
+    memQty = 1;
+    rollPhase = 0;
+    discardCurrentFft = 1;
+    newScreen(! stopped);
+  }
+
+  DBG(F, "(2) sampleRate %ld, spanHz %ld, fftSize %ld", sampleRate, spanHz, fftSize);
+  DBG(F, "(3) stepAbs %f, stepRel %f, roll %ld, fftSize %ld, chunkSize %ld", stepAbs, stepRel, roll, fftSize, chunkSize);
+
+  float sampleNumF = (startHz - zoomHz) * (float)fftSize / fsFft;
+  sampleNum = (int)(sampleNumF);
+  deltaHz = (sampleNum - sampleNumF) / (float)fftSize * fsFft;
+  xShift = ceil(deltaHz * (float)xSize / (float)spanHz + 0.0);
+  DBV(F, "(4) %f %d %f %d", sampleNumF, sampleNum, deltaHz, xShift);
+
+  columnsCalc();
+}
+
+
+void setCenter (int new_value)
+{
+  int centerHz = FIT(new_value, minHz, maxHz);
+  startHz = centerHz - spanHz / 2;
+  sprintf(resultStr, "Center: %g %s", centerHz DUNITS2STR);
+  newFft(0); // For sampleNum, at least.
+  newScreen(1);
+}
+
+void setSpan (int new_value)
+{
+  int centerHz = startHz + spanHz / 2;
+  spanHz = FIT(new_value, minSpanHz, maxSpanHz);
+  startHz = centerHz - spanHz / 2;
+  newFft(1);
+  sprintf(resultStr, "Span: %g %s", spanHz DUNITS2STR);
+}
+
+// 'direction' here & after can be -1, 1, or 0 if just fit/limit
+void setRbw (int direction)
+{
+  rbwLog = FIT(rbwLog + direction, rbwLogMin, rbwLogMax);
+  rbw = pow(2, rbwLog);
+  newFft(0);
+  sprintf(inputStr, RBW2STR);
+}
+
+void setVbw (int direction)
+{
+  vbwLog = FIT(vbwLog + direction, -1, 8);
+  vbw = (vbwLog < 0) ? 0 : 1 << vbwLog;
+  sprintf(inputStr, VBW2STR);
+  newScreen(0);
+}
+
+void setYShift (int direction)
+{
+  yDbMax = FIT(yDbMax + yDbStep * direction, -300, 100); // TODO fix limits.
+  newScreen(0);
+}
+
+void instrumentReset (int cold)
+{
+  if (cold)
+  {
+    startHz = xHzMin;
+    spanHz = xHzMax - xHzMin;
+    stepAbs = stepRel = 1.0;
+    crtRayStyle = 0;
+    for (int ch = 0; ch < MAXCH; ch++)
+    {
+      fftWindow[ch] = DEFWIN;
+      // Noise (Avg) menu is default for ENOB measurement.
+      measMode[ch] = optShowEnob;
+    }
+    stats = 0;
+    vbwLog = 0;
+    vbw = 1;
+    phosphor = defPhospor;
+  }
+
+  for (int ch = 0; ch < MAXCH; ch++)
+    inminAbsNonzero[ch] = 2.0;
+
+  setSpan(spanHz); // -> newFft(1) -> memory clear
+
+  memAddScheduled = 0;
+  inputStr[0] = inputName[0] = resultStr[0] = '\0';
+  menu = 0;
+  rePlot = 0;
+}
+
+void processMouse(int x, int y, int which)
+{
+  if ((x >= 0) && (x <= (xSize + 1)) && (y >= 0) && (y <= (ySize + 1)))
+  {
+    int fnum = ((x - xShift) / (squeeze ? stepRel : stepAbs) + 0.5);
+    marker[which] = FIT(fnum, firstUsedBin, lastUsedBin);
+  }
+}
+
+void processKeyboard (int rk)
+{
+  void inputMode (int m, char* str)
+  {
+    menu = m;
+    strcpy(inputName, str);
+    inputStr[0] = resultStr[0] = '\0';
+  }
+
+  rk = rk + 256 * menuPage;
+
+  DBV(X, "Menu %d Key %d (%d)", menu, rk % 256, rk);
+
+  // Per-channel things: menuPage == 2. F1...F9
+  if ((rk >= (67 + 512)) && (rk <= (75 + 512)))
+  {
+    int ch = (rk - (67 + 512)); // Channel 0...7; or 8 for all channels
+    int c = ch % MAXCH; // For all (8) we take 0 as reference
+    if (c < channels)
+    {
+      // Cycle 1st param:
+      // 0: Tone (Max), 1: Noise minus window NF (Avg)
+      measMode[c] = (measMode[c] + 1) % MAXMEASMODE;
+      if (measMode[c] == 0)
+        // Cycle 2nd param:
+        fftWindow[c] = (fftWindow[c] + 1) % MAXWIN;
+
+      if (ch == MAXCH)
+        for (int i = 1; i < channels; i++) // Copy reference to all
+        {
+          measMode[i] = measMode[0];
+          fftWindow[i] = fftWindow[0];
+        }
+      windowsEnsure(fftSizeK - MINFFTK);
+
+      sprintf(resultStr, "Ch. %s: %s, %s", (ch < MAXCH) ? DIGIT2STR(ch) : "All", measModeStr[measMode[c]], fftWindowStr[fftWindow[c]]);
+    }
+  }
+
+  // This numeric and some more input handle is for menuPage 0.
+  if ((menu == 1) || (menu == 2))
+  {
+    // 0..9 digits input, include keypad.
+    for (uint8_t i = 0; i < 20; i++)
+      if (rk == (uint16_t[20]){19, 90, 10, 87, 11, 88, 12, 89, 13, 83, 14, 84, 15, 85, 16, 79, 17, 80, 18, 81}[i])
+      {
+        strlcat(inputStr, DIGIT2STR(i / 2), 254);
+        break;
+      }
+
+    // Add decimal point, if not already added.
+    if ((rk == 59) || (rk == 60) || (rk == 91)) // Both ',' or '.'
+      if (strchr(inputStr, '.') == NULL)
+        strlcat(inputStr, ".", 254);
+
+    // Backspace.
+    if (rk == 22)
+      inputStr[MAX(strlen(inputStr) - 1, 0)] = '\0';
+
+    // 'h', 'k', 'm' are acts as Enter, yet define entry as Hz, kHz or MHz.
     if (((rk == 43) || (rk == 45) || (rk == 58)) && strlen(inputStr))
     {
-      units = Hz;
-      if (rk == 45) // 'k'
+      units = Hz;
+      if (rk == 45) // 'k'
+        units = kHz;
+      else if (rk == 58) // 'm'
+        units = MHz;
+
+      if (menu == 1)
+        setCenter(atof(inputStr) * units);
+      else if (menu == 2)
+        setSpan(atof(inputStr) * units);
+
+      menu = 0;
+    }
+  }
+
+  // Menu Page 0.
+  if (rk == 67) // F1
+    inputMode (1, "Center: ");
+
+  if (rk == 68) // F2
+    inputMode (2, "Span: ");
+
+  if (rk == 69) // F3: RBW
+  {
+    inputMode (3, "");
+    setRbw(0);
+  }
+
+  if (rk == 70) // F4: VBW
+  {
+    if (menu == 4)
+      vbwLog = - !vbwLog;
+
+    inputMode (4, "");
+    setVbw(0);
+  }
+
+  if (rk == 71) // F5: Marker
+  {
+    if (menu != 5)
+      mkrIsDelta = 0;
+    else
+      mkrIsDelta = (!(mkrIsDelta));
+
+    sprintf(resultStr, mkrIsDelta ? "Marker delta" : "Marker");
+    if (marker[mkrIsDelta] == -1)
+    {
+      if (mkrIsDelta)
+        mkrCh[1] = mkrCh[0];
+      // Set new marker at center using mouse click emulation.
+      processMouse(xSize / 2, 0, mkrIsDelta);
+    }
+    menu = 5;
+  }
+
+  if ((rk == 72) && (! memAddScheduled) && (memorySlots)) // F6: Memory add (Esc: clear)
+  {
+    if (phosphor)
+      memQty = 1;
+
+    phosphor = 0;
+    sprintf(resultStr, "Memory add: %d", memQty);
+    memAddScheduled = 1;
+  }
+
+  if (rk == 73) // F7
+  {
+    inputMode (7, "Y Shift: ");
+    setYShift(0);
+  }
+
+  if (rk == 74) // F8: dBV / dB Pwr
+  {
+    isDbPwr = (!(isDbPwr));
+    strcpy(resultStr, "Y Scale changed.");
+    newScreen(1);
+  }
+
+  // NOTE VBW filter can't work when stopped.
+  if (rk == 75) // F9: Stop / Run
+  {
+    stopped = (!(stopped));
+    sprintf(resultStr, stopped ? "Stopped" : "Sweep Normal");
+    if (stopped)
+    {
+      phosphor = 0;
+      memQty = 1;
+    }
+  }
+
+  // Menu Page 1: Momentary actions, like on-off.
+  if (rk == 67 + 256) // F1: Stats
+    stats = !stats;
+
+  if (rk == 68 + 256) // F2: Timing legend page
+  {
+    optTiming = !optTiming;
+    sprintf(resultStr, optTiming ? "Timing shown." : "Channels shown.");
+    legend();
+  }
+
+  if (rk == 69 + 256) // F3: Density display
+  {
+    density = !density;
+    if (density)
+    {
+      densityAlloc();
+      phosphor = 0;
+      memQty = 1;
+    }
+    discardCurrentFft = 1; // Channels of current spectrum must all agree.
+    sprintf(resultStr, density ? "Density: %d ms half-life" : "Density off", densityMs);
+    legend();
+  }
+
+  if (rk == 71 + 256) // F5: Mkr to Center
+    if (marker[0] != -1)
+    {
+      // Note: freqHz is valid after marker was drawn once.
+      setCenter((int) freqHz);
+      processMouse(xSize / 2, 0, 0);
+    }
+
+  if (rk == 72 + 256) // F6: StepRel
+  {
+    menu = 0;
+    strcpy(inputStr, "");
+    double stepRelOld = stepRel;
+    stepRel = stepRel / 2.0;
+    if (stepRel < MAX(MINSTEP, stepAbs))
+      stepRel = MAXSTEP;
+
+    if (stepRelOld != stepRel)
+    {
+      columnsCalc();
+      newScreen(1);
+    }
+
+    sprintf(resultStr, "stepRel: %g points", stepRel);
+  }
+
+  if (rk == 73 + 256) // F7: Phosphor
+  {
+    density = 0;
+    if (! phosphor)
+      phosphor = 1;
+    else
+    {
+      phosphor = phosphor * 2;
+      if (phosphor > MAXPHOSPHOR)
+        phosphor = 0;
+    }
+    sprintf(resultStr, PHOSPHOR2STR);
+    legend();
+
+    if (! phosphor)
+      memQty = 1;
+  }
+
+  if (rk == 74 + 256) // F8: Line Style
+  {
+    crtRayStyle = (crtRayStyle + 1) % 9; // 0 = auto, or 1...8
+    sprintf(resultStr, "Line Style: %s", crtRayStyle ? DIGIT2STR(crtRayStyle) : "Auto");
+  }
+
+  if (rk == 75 + 256)  // F9: Reset
+    instrumentReset(1);
+
+
+  // The following will work for all menu pages.
+  rk = rk % 256;
+
+  if ((rk == 23) || (rk == 2)) // Tab, Mouse middle click
+    mkrCh[mkrIsDelta] = (mkrCh[mkrIsDelta] + 1) % channels;
+
+  int direction = 0;
+  int multiplier = 1;
+
+  // minus, <-, '-', 'up arrow', PgUp, mouse wheel
+  if ((rk==20) || (rk==82) || (rk==113) || (rk==111) || (rk==112) || (rk == (5 - optRevWheel)))
+    direction = -1;
+
+  // plus, ->, '+', 'down arrow', PgDown, mouse wheel
+  if ((rk==21) || (rk==86) || (rk==114) || (rk==116) || (rk==117) || (rk == (4 + optRevWheel)))
+    direction = 1;
+
+  // Marker jog: 'up arrow', PgUp, 'down arrow', PgDown
+  if ((rk==111) || (rk==112) || (rk==116) || (rk==117))
+    multiplier = squeeze ? (stepRel * xSize / xGrids) : 10;
+
+  if (direction != 0)
+    switch (menu)
+    {
+      case 1:
+        if (strlen(inputStr))
+          break;
+
         units = kHz;
-      else if (rk == 58) // 'm'
-        units = MHz;
 
-      if (menu == 1)
-        setCenter(atof(inputStr) * units);
-      else if (menu == 2)
-        setSpan(atof(inputStr) * units);
+        setCenter(startHz + spanHz / 2 + (spanHz / 10) * direction);
+        break;
+
+      case 2:
+        if (strlen(inputStr))
+          break;
+
+        int span = spanHz;
+
+        float exponent = pow(10, (int)(log10(span)));
+        float m = span / exponent;
+        if (direction > 0)
+        {
+          if      (m < 2.0)
+            m = 2.0;
+          else if (m < 5.0)
+            m = 5.0;
+          else
+            m = 10.0;
+        }
+        else
+        {
+          if      (m > 5.0)
+            m = 5.0;
+          else if (m > 2.0)
+            m = 2.0;
+          else if (m > 1.0)
+            m = 1.0;
+          else
+            m = 0.5;
+        }
+        span = m * exponent;
+        // TODO review all units manage.
+        (span < 0.1 * kHz) ? (units = Hz) : (units = kHz);
+        setSpan (span);
+        break;
+
+      case 3:
+        setRbw(- direction);
+        break;
+
+      case 4:
+        setVbw(- direction);
+        break;
+
+      case 5:
+        if (marker[mkrIsDelta] != -1)
+          marker[mkrIsDelta] = FIT(marker[mkrIsDelta] + direction * multiplier, firstUsedBin, lastUsedBin);
+        break;
+
+      case 7:
+        setYShift(direction);
+        break;
+    }
+
+  if (rk == 110) // 'home'
+    if ((menu == 5) && (marker[mkrIsDelta] != -1))
+      marker[mkrIsDelta] = firstUsedBin;
+
+  if (rk == 115) // 'end'
+    if ((menu == 5) && (marker[mkrIsDelta] != -1))
+      marker[mkrIsDelta] = lastUsedBin;
+
+  if (rk == 9) // Esc
+    instrumentReset(0);
+
+  if (rk == 53) // 'x' aka Ctrl+x
+  {
+    menu = 0;
+    sprintf(resultStr, "Exit.");
+    programExit = 1;
+  }
+
+  if (rk == 76) // F10
+    menuPage = (menuPage + 1) % 3;
+  else
+  {
+    if (menuPage == 1)
+      menuPage = menu = 0;
+
+    rePlot = 1;
+  }
+
+  plotBottomHelp();
+  printParam();
+
+  DBV(X, "Menu %d ", menu);
+}
+
+
+// Engine holds state lock while it processes, and display thread takes it only to process input; then engine is asked to pause via uiPending at its next channel or frame boundary.
+pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+volatile int uiPending = 0;
+
+// Display thread waits for frames here, with timeout to keep input alive.
+pthread_mutex_t render_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t frame_ready = PTHREAD_COND_INITIALIZER;
+
+// Lock-free triple buffer. Index in frameMiddle has FRESH bit when it was not taken yet.
+#define FRESH 4
+int frameBack = 0, frameMiddle = 1, frameFront = 2;
+
+void renderWake()
+{
+  // Same as process() does: no need to signal if display thread is busy, it will check for frame before it waits again.
+  if (pthread_mutex_trylock (&render_lock) == 0)
+  {
+    pthread_cond_signal (&frame_ready);
+    pthread_mutex_unlock (&render_lock);
+  }
+}
+
+// Engine side. Only used part of data is copied.
+void framePublish()
+{
+  frame_t *f = &frames[frameBack];
+
+  for (int m = 0; m < memQty; m++)
+  {
+    int mem = (memCurr - m + MAXMEM) % MAXMEM;
+    for (int ch = 0; ch < channels; ch++)
+    {
+      trace_t *tr = &trace[mem][ch];
+      f->trace[mem][ch] = *tr;
+      if ((tr->gen == screenGen) && (tr->lo <= tr->hi))
+        memcpy(TRACE(f->data, mem, ch) + tr->lo, TRACE(data, mem, ch) + tr->lo, (tr->hi - tr->lo + 1) * sizeof(int16_t));
+    }
+  }
+
+  // Waterfall row is max of all spectra since display took last frame. If it takes one just now, row may repeat, but
+  // spectrum is never lost.
+  if (wfRows)
+  {
+    if ((wfAccGen != screenGen) || (! (__atomic_load_n(&frameMiddle, __ATOMIC_ACQUIRE) & FRESH)))
+    {
+      for (uint64_t i = 0; i < channels * (uint64_t)dataBins; i++)
+        wfAcc[i] = NODATA;
+      wfAccGen = screenGen;
+    }
+    for (int ch = 0; ch < channels; ch++)
+    {
+      trace_t *tr = &trace[memCurr][ch];
+      int16_t *row = TRACE(data, memCurr, ch), *acc = wfAcc + ch * (uint64_t)dataBins;
+      if (tr->gen == screenGen)
+        for (int i = tr->lo; i <= tr->hi; i++)
+          acc[i] = MAX(acc[i], row[i]);
+    }
+    memcpy(f->wf, wfAcc, channels * dataBins * sizeof(int16_t));
+  }
+
+  f->memCurr = memCurr;
+  f->memQty = memQty;
+  f->firstUsedBin = firstUsedBin;
+  f->lastUsedBin = lastUsedBin;
+  f->amptZero = amptZero;
+  f->amptMax = amptMax;
+  f->amptOverload = amptOverload;
+  f->lowCpu = lowCpu;
+  f->gen = screenGen;
+
+  amptZero = amptMax = amptOverload = -1;
+
+  frameBack = __atomic_exchange_n(&frameMiddle, frameBack | FRESH, __ATOMIC_ACQ_REL) & 3;
+  renderWake();
+}
 
-      menu = 0;
-    }
-  }
+// Display side. Returns NULL if no new frame since last call.
+frame_t *frameTake()
+{
+  if (! (__atomic_load_n(&frameMiddle, __ATOMIC_ACQUIRE) & FRESH))
+    return NULL;
 
-  // Menu Page 0.
-  if (rk == 67) // F1
-    inputMode (1, "Center: ");
+  frameFront = __atomic_exchange_n(&frameMiddle, frameFront, __ATOMIC_ACQ_REL) & 3;
+  return &frames[frameFront];
+}
 
-  if (rk == 68) // F2
-    inputMode (2, "Span: ");
+void processMessages()
+{
+  if ((! XPending(dpy)) && (! planUpgradePending()))
+    return;
 
-  if (rk == 69) // F3: RBW
+  // Never wait for engine here: input stays queued until it gives us the lock.
+  if (pthread_mutex_trylock (&state_lock) != 0)
   {
-    inputMode (3, "");
-    setRbw(0);
+    uiPending = 1;
+    return;
   }
 
-  if (rk == 70) // F4: VBW
+  while(XPending(dpy))
   {
-    if (menu == 4)
-      vbwLog = - !vbwLog;
+    DBV(X, "Keyboard, mouse or X11 process.");
 
-    inputMode (4, "");
-    setVbw(0);
-  }
+    XEvent e;
+    XNextEvent(dpy, &e);
 
-  if (rk == 71) // F5: Marker
-  {
-    if (menu != 5)
-      mkrIsDelta = 0;
-    else
-      mkrIsDelta = (!(mkrIsDelta));
+    if (e.type == ClientMessage)
+      if ((Atom)e.xclient.data.l[0] == wm_delete_window) // [14] [15]
+      {
+        DBG(X, "Close window signal received.");
+        programExit = 1;
+      }
 
-    sprintf(resultStr, mkrIsDelta ? "Marker delta" : "Marker");
-    if (marker[mkrIsDelta] == -1)
+    if (e.type == Expose)
+      XFlushArea(0, 0, winW, winH);
+
+    if (e.type == KeyPress)
+      processKeyboard(e.xkey.keycode);
+
+    if (e.type == ButtonPress)
     {
-      if (mkrIsDelta)
-        mkrCh[1] = mkrCh[0];
-      // Set new marker at center using mouse click emulation.
-      processMouse(xSize / 2, 0, mkrIsDelta);
+      if ((e.xbutton.button == Button2) || (e.xbutton.button > Button3))
+        // Mouse wheel gives 4 or 5, good for keyboard mimic: X11 keyboard codes are starts from 8.
+        processKeyboard(e.xbutton.button);
+      else
+        processMouse((int)(e.xbutton.x / glScale - DX), (int)(e.xbutton.y / glScale - DY), (e.xbutton.button != Button1));
     }
-    menu = 5;
   }
 
-  if ((rk == 72) && (! memAddScheduled) && (memorySlots)) // F6: Memory add (Esc: clear)
+  // Wanted FFT size is built by planner thread, switch to it.
+  if (planUpgradePending())
+    newFft(0);
+
+  uiPending = 0;
+  pthread_mutex_unlock (&state_lock);
+}
+
+
+// JACK threads.
+typedef struct _thread_info
+{
+  pthread_t thread_id;
+  jack_nframes_t rb_size;
+  jack_client_t *client;
+  unsigned int channels;
+  volatile int can_capture;
+  volatile int can_process;
+  volatile int status;
+} jack_thread_info_t;
+
+/* JACK data */
+unsigned int nports = 0;
+jack_port_t **ports = NULL;
+jack_default_audio_sample_t **jack_in = NULL;
+jack_nframes_t nframes;
+
+/* Synchronization between process thread && disk thread. */
+jack_ringbuffer_t *rb = NULL;
+pthread_mutex_t disk_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t data_ready = PTHREAD_COND_INITIALIZER;
+jack_client_t *client = NULL;
+
+// Engine input buffer: interleaved copy of ringbuffer, FFT size or more.
+void *buf;
+uint64_t bufSize;
+uint64_t bufSizeInSamples;
+int64_t bufReadoutPointer;
+int planNum;
+
+// Stage 1 fused kernel: gather one channel from interleaved float samples, multiply by window, and collect
+// min, max, min-abs-nonzero stats, all in one pass. It is written plain, to be vectorized by compiler; clones for
+// AVX-512, AVX2 and baseline (SSE2) are selected at run time. Window goes backwards when step is -1.
+// Stats are float: samples are float, so no precision is lost.
+#if defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+#define WINKERNEL(name, T, W, IQ) \
+SIMD_CLONES void name(void *dstv, const float *restrict src, uint64_t stride, const void *winv, int64_t step, uint64_t n, float *mm) \
+{ \
+  T *restrict dst = dstv; \
+  const W *restrict wf = winv; \
+  float Min = mm[0], Max = mm[1], MinNZ = mm[2]; \
+  for (uint64_t i = 0; i < n; i++) \
+  { \
+    W w = wf[(int64_t)i * step]; \
+    for (int c = 0; c <= IQ; c++) \
+    { \
+      float x = src[i * stride + c]; \
+      dst[i * (IQ + 1) + c] = x * w; \
+      Min = fminf(Min, x); \
+      Max = fmaxf(Max, x); \
+      MinNZ = fminf(MinNZ, (x != 0) ? fabsf(x) : FLT_MAX); \
+    } \
+  } \
+  mm[0] = Min; mm[1] = Max; mm[2] = MinNZ; \
+}
+
+WINKERNEL(winKernelDDR, double, double, 0)
+WINKERNEL(winKernelDDC, double, double, 1)
+WINKERNEL(winKernelDFR, double, float,  0)
+WINKERNEL(winKernelDFC, double, float,  1)
+WINKERNEL(winKernelFDR, float,  double, 0)
+WINKERNEL(winKernelFDC, float,  double, 1)
+WINKERNEL(winKernelFFR, float,  float,  0)
+WINKERNEL(winKernelFFC, float,  float,  1)
+
+// Index: SINGLE, optWinFloat, optIQ bits.
+void (*winKernel[8])(void *dst, const float *src, uint64_t stride, const void *win, int64_t step, uint64_t n, float *mm) = {
+  winKernelDDR, winKernelDDC, winKernelDFR, winKernelDFC, winKernelFDR, winKernelFDC, winKernelFFR, winKernelFFC };
+
+// Stage 3 kernel: max and sum of power (i*i + q*q) of FFT output points a ... b, for one screen column.
+#define POWERKERNEL(name, T) \
+SIMD_CLONES void name(const void *outv, int a, int b, double *pmax, double *psum) \
+{ \
+  const T (*restrict out)[2] = outv; \
+  T m = *pmax; \
+  double sum = *psum; \
+  for (int i = a; i <= b; i++) \
+  { \
+    T p = out[i][0] * out[i][0] + out[i][1] * out[i][1]; \
+    m = (p > m) ? p : m; \
+    sum += p; \
+  } \
+  *pmax = m; \
+  *psum = sum; \
+}
+
+POWERKERNEL(powerReduceD, double)
+POWERKERNEL(powerReduceF, float)
+
+// Index: SINGLE.
+void (*powerReduce[2])(const void *out, int a, int b, double *pmax, double *psum) = { powerReduceD, powerReduceF };
+
+// Zoom FFT, -Z. Narrow span around center zoomHz is mixed down to 0 Hz by complex NCO, then decimated by cascade of
+// half-band FIR stages, each by 2. Smaller FFT at decimated rate gives same RBW, and FFT size limit (-k) is not a limit
+// for resolution anymore. Half-band filter has every second tap zero, and passband is 0.8 of its output band, see newFft().
+#define HBTAPS 79 // Kaiser, beta 12.26, ~120 dB stopband
+double hbCoef[HBTAPS];
+
+typedef struct {
+  double nco[2], ncoStep[2];             // Rotator, exp(-j 2 pi zoomHz n / sampleRate)
+  double hist[MAXZOOM][HBTAPS * 2][2];   // Stage delay lines, written twice, so taps are always contiguous
+  int histPos[MAXZOOM], phase[MAXZOOM];
+  double (*ring)[2];                     // Decimated complex output, ringSize: largest fftSize since start
+  uint64_t ringSize, ringPos, count;
+  float mm[3];                           // Raw input min, max, min-abs-nonzero
+} zoom_t;
+zoom_t zoom[MAXCH];
+
+uint64_t zoomFrom, zoomFrames; // Engine: samples to feed, and where they start in buf
+int zoomGenSeen = -1;
+
+// Modified Bessel I0, for Kaiser window.
+double besselI0(double x)
+{
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; k++)
   {
-    if (phosphor)
-      memQty = 1;
+    term = term * (x / (2.0 * k)) * (x / (2.0 * k));
+    sum = sum + term;
+  }
+  return sum;
+}
 
-    phosphor = 0;
-    sprintf(resultStr, "Memory add: %d", memQty);
-    memAddScheduled = 1;
+void zoomCoefCalc(void)
+{
+  int m = HBTAPS / 2;
+  double beta = 12.26, sum = 0;
+  for (int i = 0; i < HBTAPS; i++)
+  {
+    int n = i - m;
+    double r = n / (double)m;
+    hbCoef[i] = (n == 0) ? 0.5 : ((n % 2) ? sin(M_PI * n / 2.0) / (M_PI * n) : 0.0);
+    hbCoef[i] = hbCoef[i] * besselI0(beta * sqrt(1.0 - r * r)) / besselI0(beta);
+    sum = sum + hbCoef[i];
   }
+  // Unity DC gain.
+  for (int i = 0; i < HBTAPS; i++)
+    hbCoef[i] = hbCoef[i] / sum;
+}
 
-  if (rk == 73) // F7
+// Ring is not cleared: FFT waits until it has fftSize new samples.
+void zoomReset(zoom_t *z)
+{
+  if (z->ringSize < fftSize)
   {
-    inputMode (7, "Y Shift: ");
-    setYShift(0);
+    free(z->ring);
+    z->ring = malloc(fftSize * sizeof(double[2]));
+    z->ringSize = fftSize;
   }
+  memset(z->hist, 0, sizeof(z->hist));
+  memset(z->histPos, 0, sizeof(z->histPos));
+  memset(z->phase, 0, sizeof(z->phase));
+  z->ringPos = z->count = 0;
+  z->nco[0] = 1.0;
+  z->nco[1] = 0.0;
+  z->ncoStep[0] = cos(2.0 * M_PI * zoomHz / sampleRate);
+  z->ncoStep[1] = - sin(2.0 * M_PI * zoomHz / sampleRate);
+  z->mm[0] = z->mm[1] = 0;
+  z->mm[2] = FLT_MAX;
+}
 
-  if (rk == 74) // F8: dBV / dB Pwr
+// Push one sample into stage s; each stage takes every second output of its filter.
+void zoomPush(zoom_t *z, int s, double re, double im)
+{
+  if (s == zoomStages)
   {
-    isDbPwr = (!(isDbPwr));
-    strcpy(resultStr, "Y Scale changed.");
-    newScreen(1);
+    z->ring[z->ringPos][0] = re;
+    z->ring[z->ringPos][1] = im;
+    z->ringPos = (z->ringPos + 1) & (z->ringSize - 1);
+    z->count++;
+    return;
   }
 
-  // NOTE VBW filter can't work when stopped.
-  if (rk == 75) // F9: Stop / Run
+  int pos = z->histPos[s] = (z->histPos[s] + 1) % HBTAPS;
+  double (*h)[2] = z->hist[s];
+  h[pos][0] = h[pos + HBTAPS][0] = re;
+  h[pos][1] = h[pos + HBTAPS][1] = im;
+
+  if ((z->phase[s] ^= 1))
+    return;
+
+  // Only odd taps and center are nonzero; filter is symmetrical.
+  double (*x)[2] = h + pos + 1;
+  double yr = hbCoef[HBTAPS / 2] * x[HBTAPS / 2][0];
+  double yi = hbCoef[HBTAPS / 2] * x[HBTAPS / 2][1];
+  for (int i = 1; i <= HBTAPS / 2; i += 2)
   {
-    stopped = (!(stopped));
-    sprintf(resultStr, stopped ? "Stopped" : "Sweep Normal");
-    if (stopped)
+    int a = HBTAPS / 2 - i, b = HBTAPS / 2 + i;
+    yr = yr + hbCoef[a] * (x[a][0] + x[b][0]);
+    yi = yi + hbCoef[a] * (x[a][1] + x[b][1]);
+  }
+  zoomPush(z, s + 1, yr, yi);
+}
+
+// Mix down and decimate zoomFrames new samples of channel, from engine buf.
+void zoomFeed(int ch, int worker)
+{
+  uint64_t t = nsNow();
+  zoom_t *z = &zoom[ch];
+  uint64_t p = zoomFrom;
+  float Min = z->mm[0], Max = z->mm[1], MinNZ = z->mm[2];
+
+  for (uint64_t i = 0; i < zoomFrames; i++)
+  {
+    float re = ((float *)buf)[p + ch * (1 + optIQ)];
+    float im = optIQ ? ((float *)buf)[p + ch * 2 + 1] : 0;
+
+    Min = fminf(Min, fminf(re, optIQ ? im : re));
+    Max = fmaxf(Max, fmaxf(re, optIQ ? im : re));
+    if (re != 0)
+      MinNZ = fminf(MinNZ, fabsf(re));
+    if (im != 0)
+      MinNZ = fminf(MinNZ, fabsf(im));
+
+    double nr = z->nco[0] * z->ncoStep[0] - z->nco[1] * z->ncoStep[1];
+    double ni = z->nco[0] * z->ncoStep[1] + z->nco[1] * z->ncoStep[0];
+    zoomPush(z, 0, re * z->nco[0] - im * z->nco[1], re * z->nco[1] + im * z->nco[0]);
+    z->nco[0] = nr;
+    z->nco[1] = ni;
+
+    p += jackPorts;
+    if (p >= bufSizeInSamples)
+      p = 0;
+  }
+
+  // Rotator amplitude drifts slowly by rounding; keep it at unity.
+  double r = 1.0 / hypot(z->nco[0], z->nco[1]);
+  z->nco[0] = z->nco[0] * r;
+  z->nco[1] = z->nco[1] * r;
+
+  z->mm[0] = Min;
+  z->mm[1] = Max;
+  z->mm[2] = MinNZ;
+
+  timerAdd(T_DDC, t, ch);
+}
+
+// Stage 1, 2 and 3 are separate, as batched FFT needs all channels windowed before, and only then post-processed.
+void channelWindow(int ch, int worker)
+{
+  ch = ch % MAXCH;
+  inmin[ch] = 0.0;
+  inmax[ch] = 0.0;
+
+  // Stage 1: Pre-process FFT data:
+  // * Gathering;
+  // * Windowing;
+  // * Amplitude Zero, Min, Max checks.
+  uint64_t t = nsNow();
+  double Min = inmin[ch];
+  double MinNZ = inminAbsNonzero[ch];
+  double Max = inmax[ch];
+
+  uint8_t winNum = fftWindow[ch] % MAXWIN;
+  // Loops are unswitched by compiler for one of two.
+  double *wd = windowfunc[planNum][winNum];
+  float *wf = windowfuncF[planNum][winNum];
+#define WIN(i) (optWinFloat ? wf[i] : wd[i])
+
+  if (zoomD > 1)
+  {
+    // Zoomed: last fftSize decimated complex samples; stats are of raw input, collected by zoomFeed().
+    zoom_t *z = &zoom[ch];
+    uint64_t mask = z->ringSize - 1;
+    uint64_t r = z->ringPos - fftSize;
+    for (uint64_t i = 0; i < fftSize; i++)
     {
-      phosphor = 0;
-      memQty = 1;
+      double w = (i < fftSize / 2) ? WIN(i) : WIN(fftSize - 1 - i);
+      double *x = z->ring[(r + i) & mask];
+      if SINGLE
+      {
+        fftinF[ch][i][0] = x[0] * w;
+        fftinF[ch][i][1] = x[1] * w;
+      }
+      else
+      {
+        fftin[ch][i][0] = x[0] * w;
+        fftin[ch][i][1] = x[1] * w;
+      }
     }
+
+    Min = z->mm[0];
+    Max = z->mm[1];
+    MinNZ = z->mm[2];
+    z->mm[0] = z->mm[1] = 0;
+    z->mm[2] = FLT_MAX;
+    goto stats;
   }
 
-  // Menu Page 1: Momentary actions, like on-off.
-  if (rk == 67 + 256) // F1: Stats
-    stats = !stats;
+  uint64_t bufReadoutSamplePointer = bufReadoutPointer / sample_size_4bytes;
 
-  if (rk == 71 + 256) // F5: Mkr to Center
-    if (marker[0] != -1)
+#ifdef straight
+  // This one can't be vectorized, because sample is not known each next cycle.
+// TODO add i,q! NOTE
+  for (uint64_t i = 0; i < fftSize; i++)
+  {
+    double sample;
+
+    // NOTE Here is point of loss of precision: JACK is float.
+    sample = ((float *)buf)[bufReadoutSamplePointer + ch];
+
+    bufReadoutSamplePointer = bufReadoutSamplePointer + channels;
+    // Should never be >, only ==, but still.
+    if (bufReadoutSamplePointer >= bufSizeInSamples)
+      bufReadoutSamplePointer = 0;
+
+    if (1)
+      // We use only left half of window, then mirroring it.
+      if (i < (fftSize / 2))
+        fftinR[ch][i] = sample * WIN(i);
+      else
+        fftinR[ch][i] = sample * WIN(fftSize - 1 - i);
+    else
+      fftinR[ch][i] = sample; // When window = NoWindow
+
+    Min = fmin(Min, sample);
+    Max = fmax(Max, sample);
+    if (sample != 0)
+      MinNZ = fmin(MinNZ, fabs(sample));
+  }
+#else
+  // One pass: gather from interleaved ring, window (mirrored for second half), and stats; see winKernel().
+  // Range is split at ring wrap and at window middle, so kernel runs over contiguous pieces only.
+  float mm[3] = {Min, Max, MinNZ};
+  int k = (SINGLE ? 4 : 0) + (optWinFloat ? 2 : 0) + optIQ;
+  uint64_t sampleSize = (optIQ ? 2 : 1) * realSize;
+  uint8_t *dst = optIQ ? (uint8_t *)fftin[ch] : (uint8_t *)fftinR[ch];
+  uint64_t winSize = optWinFloat ? sizeof(float) : sizeof(double);
+  uint8_t *winp = optWinFloat ? (uint8_t *)wf : (uint8_t *)wd;
+
+  for (uint64_t i = 0, n; i < fftSize; i += n)
+  {
+    n = MIN(fftSize - i, (bufSizeInSamples - bufReadoutSamplePointer) / jackPorts);
+    int64_t winStep = 1;
+    uint64_t w = i;
+    if (i < fftSize / 2)
+      n = MIN(n, fftSize / 2 - i);
+    else
     {
-      // Note: freqHz is valid after marker was drawn once.
-      setCenter((int) freqHz);
-      processMouse(xSize / 2, 0, 0);
+      winStep = -1;
+      w = fftSize - 1 - i;
     }
 
-  if (rk == 72 + 256) // F6: StepRel
+    winKernel[k](dst + i * sampleSize, (float *)buf + bufReadoutSamplePointer + ch * (1 + optIQ), jackPorts, winp + w * winSize, winStep, n, mm);
+
+    bufReadoutSamplePointer += n * jackPorts;
+    // Should never be >, only ==, but still.
+    if (bufReadoutSamplePointer >= bufSizeInSamples)
+      bufReadoutSamplePointer = 0;
+  }
+
+  Min = mm[0];
+  Max = mm[1];
+  MinNZ = mm[2];
+#endif
+
+ stats:
+  inmin[ch] = fmin(Min, inmin[ch]);
+  inminAbsNonzero[ch] = fmin(MinNZ, inminAbsNonzero[ch]);
+  inmax[ch] = fmax(Max, inmax[ch]);
+
+  if ((inmin[ch] < -1.0) || (inmax[ch] > 1.0))
+    amptOverload = ch;
+
+  // Exact match is rare thing, but we behave as precise as possible. Good to check if our samples were not scaled on the road.
+  if ((inmin[ch] == -1.0) || (inmax[ch] == 1.0))
+    amptMax = ch;
+
+  if (inmax[ch] == 0.0)
+    amptZero = ch;
+
+  timerAdd(T_WINDOW, t, ch);
+}
+
+void channelFft(int ch, int worker)
+{
+  // Stage 2: Do FFT.
+  if (! stopped)
   {
-    menu = 0;
-    strcpy(inputStr, "");
-    double stepRelOld = stepRel;
-    stepRel = stepRel / 2.0;
-    if (stepRel < MAX(MINSTEP, stepAbs))
-      stepRel = MAXSTEP;
+    uint64_t t = nsNow();
+    DBV(F, "Ch. %d Started fft plan execute.", ch);
 
-    if (stepRelOld != stepRel)
-      newScreen(1);
+    // Zoomed input is always complex.
+    int cplx = optIQ || (zoomD > 1);
 
-    sprintf(resultStr, "stepRel: %g points", stepRel);
+    if (KFR && SINGLE)
+      if (cplx)
+        kfr_dft_execute_f32(plan_kfr_f32[planNum], fftoutF[ch][0], fftinF[ch][0], tmp[worker]);
+      else
+        kfr_dft_real_execute_f32(plan_kfr_real_f32[planNum], fftoutF[ch][0], fftinRF[ch], tmp[worker]);
+    else if KFR
+      if (cplx)
+        kfr_dft_execute_f64(plan_kfr[planNum], fftout[ch][0], fftin[ch][0], tmp[worker]);
+      else
+        kfr_dft_real_execute_f64(plan_kfr_real[planNum], fftout[ch][0], fftinR[ch], tmp[worker]);
+    else if SINGLE
+      if (cplx)
+        fftwf_execute_dft((zoomD > 1) ? plan_fftwzf[planNum] : plan_fftwf[planNum], fftinF[ch], fftoutF[ch]);
+      else
+        fftwf_execute_dft_r2c(plan_fftwf[planNum], fftinRF[ch], fftoutF[ch]);
+    else
+      if (cplx)
+        fftw_execute_dft((zoomD > 1) ? plan_fftwz[planNum] : plan_fftw[planNum], fftin[ch], fftout[ch]);
+      else
+        fftw_execute_dft_r2c(plan_fftw[planNum], fftinR[ch], fftout[ch]);
+
+    DBV(F, "Ch. %d Finished fft plan execute.", ch);
+    timerAdd(T_FFT, t, ch);
   }
+}
 
-  if (rk == 73 + 256) // F7: Phosphor
+// Density display, engine side: line of this spectrum as column spans, from same points plotOneChannel() makes.
+// Line between points spans columns it crosses, so wide steps (stepAbs > 1) are not holes.
+void densitySpans(int ch, int16_t *row, int first, int last)
+{
+  span_t *s = DENSSLOT(densHead % DENSRING, ch);
+  for (int x = 0; x <= xSize; x++)
   {
-    if (! phosphor)
-      phosphor = 1;
+    s[x].lo = ySize + 1;
+    s[x].hi = -1;
+  }
+
+  void put(int x, int y0, int y1)
+  {
+    s[x].lo = MIN(s[x].lo, MIN(y0, y1));
+    s[x].hi = MAX(s[x].hi, MAX(y0, y1));
+  }
+
+  int px = -1, py = 0;
+  for (int i = MAX(first, 0); i <= last; i++)
+  {
+    int x = (int)(i * (squeeze ? stepRel : stepAbs) + 0.0) + xShift;
+    if ((row[i] == NODATA) || (x < 0) || (x > xSize))
+      continue;
+
+    int y = scalingYcoe0 - row[i] * scalingYcoe1;
+    y = FIT(y, 0, ySize);
+
+    if (px < 0)
+      put(x, y, y);
+    else if (x == px)
+      put(x, py, y);
     else
-    {
-      phosphor = phosphor * 2;
-      if (phosphor > MAXPHOSPHOR)
-        phosphor = 0;
-    }
-    sprintf(resultStr, PHOSPHOR2STR);
-    legend();
+      for (int c = px + 1; c <= x; c++)
+        put(c, py + (y - py) * (c - 1 - px) / (x - px), py + (y - py) * (c - px) / (x - px));
 
-    if (! phosphor)
-      memQty = 1;
+    px = x;
+    py = y;
   }
+}
 
-  if (rk == 74 + 256) // F8: Line Style
+void channelPost(int ch, int worker)
+{
+  uint64_t t = nsNow();
+
+  // Stage 3: Post-process FFT result:
+  // * Convert complex (i, q) data to power;
+  // * Averaging;
+  // * Leveling, include Window Noise Figure (NF) apply;
+  // * Fit FFT bins to screen bins;
+  // * Translate to screen's dB;
+  // * Apply video filter;
+  // * Store to data array to allow multiple reuse it.
+  double winNFbins = 1.0;
+  if AVERAGE
+    winNFbins = fftWindowNFbins[fftWindow[ch]];
+
+  double coe0 = 10.0 * intDbScale / (double)(2 - isDbPwr);
+  double coe1 = log10(1.0 / ((double)fftSize / (double)(2 - optIQ))) * 2.0 + log10(1.0 / winNFbins);
+
+  int16_t *row = TRACE(data, memCurr, ch);
+  int16_t *prev = TRACE(data, memPrev, ch);
+
+  void storeBin(int bin, double power)
   {
-    crtRayStyle = (crtRayStyle + 1) % 9; // 0 = auto, or 1...8
-    sprintf(resultStr, "Line Style: %s", crtRayStyle ? DIGIT2STR(crtRayStyle) : "Auto");
+    int fftDb = MAX(roundf(coe0 * (power + coe1)), NODATA + 1);
+    // Our video filter is per-point IIR LPF.
+    // Note: video filter can't work when stopped; it is run time thing.
+    if ((vbw > 1) && (vbwContinue))
+      row[bin] = (fftDb + prev[bin] * (vbw - 1)) / (float)vbw;
+    else if ((vbw == 0) && (vbwContinue)) // Max hold
+      row[bin] = MAX(fftDb, prev[bin]);
+
+    else
+      row[bin] = fftDb;
+  }
+
+  // It allow even more correct markers near center, while anyway they will be approximate unless zoomed-in well (narrower span to exact view).
+  // float centeringShift = (squeeze) ? (fmod((((double)spanHz / 2.0 + ((startHz < 0) ? - startHz : 0)) * (double)fftSize / (double)sampleRate) - 1.0, 2.0) - 0.5) : 0;
+  float centeringShift = 0;
+
+  int firstSampleOffset = (int)((startHz - zoomHz) * (float)fftSize / fsFft + centeringShift);
+  // Same for all channels; locals, as channels can run in parallel.
+  int firstBin = -1;
+  int lastBin = 0;
+
+  // For real input: The output is n/2+1 complex numbers. [6]
+  // For complex input: The output should be just n.
+  // Note, for complex input, we plot Nyquist point twice, at start and end of plot: so we have symmetrical n+1 point plot, while fftw gives us n point output.
+  int validFirst = ((optIQ || (zoomD > 1)) ? -((int)fftSize / 2) : 0) - firstSampleOffset;
+  int validLast = ((int)fftSize / 2) - firstSampleOffset;
+
+  // Each screen column is reduced in linear power domain, then one log for it.
+  // More data compress to less video is not easy, uses bins, and can be bin averaging or max method, but not interpolate. See also [1]:p.17, "Note that the averaging must be done with the power spectrum (PS) [...], not with their square roots.
+  for (int bin = 0; bin < cols; bin++)
+  {
+    int a = MAX(colStart[bin], validFirst);
+    int b = MIN(colStart[bin + 1] - 1, validLast);
+    if (a > b)
+      continue;
+
+    if (firstBin == -1)
+      firstBin = bin;
+    lastBin = bin;
+
+    double pmax = 0, psum = 0;
+    // Negative frequencies (complex input) are at the end of FFT output.
+    a += firstSampleOffset;
+    b += firstSampleOffset;
+    if (a < 0)
+      powerReduce[!! SINGLE](SINGLE ? (void *)fftoutF[ch] : (void *)fftout[ch], a + fftSize, MIN(b, -1) + fftSize, &pmax, &psum);
+    if (b >= 0)
+      powerReduce[!! SINGLE](SINGLE ? (void *)fftoutF[ch] : (void *)fftout[ch], MAX(a, 0), b, &pmax, &psum);
+
+    if (pmax == 0)
+      row[bin] = NODATA + optShowZero;
+    else
+      storeBin(bin, log10(AVERAGE ? psum / (b - a + 1) : pmax));
+  }
+
+  // Written bins are contiguous.
+  trace[memCurr][ch].gen = screenGen;
+  trace[memCurr][ch].lo = (firstBin < 0) ? 1 : firstBin;
+  trace[memCurr][ch].hi = (firstBin < 0) ? 0 : lastBin;
+
+  if ((density) && (! stopped))
+    densitySpans(ch, row, firstBin, lastBin);
+
+  if (ch == 0)
+  {
+    firstUsedBin = firstBin;
+    lastUsedBin = lastBin;
+  }
+
+  timerAdd(T_POST, t, ch);
+}
+
+void fftExecuteAndProcessOneChannel(int ch, int worker)
+{
+  channelWindow(ch, worker);
+  channelFft(ch, worker);
+  channelPost(ch, worker);
+}
+
+// Batched FFT of all channels at once, see -B.
+void channelsFftBatch(void)
+{
+  if (! stopped)
+  {
+    uint64_t t = nsNow();
+    if (SINGLE)
+      if (optIQ)
+        fftwf_execute_dft(plan_batchf[planNum], fftinF[0], fftoutF[0]);
+      else
+        fftwf_execute_dft_r2c(plan_batchf[planNum], fftinRF[0], fftoutF[0]);
+    else
+      if (optIQ)
+        fftw_execute_dft(plan_batch[planNum], fftin[0], fftout[0]);
+      else
+        fftw_execute_dft_r2c(plan_batch[planNum], fftinR[0], fftout[0]);
+    timerAdd(T_FFT, t, -1);
   }
+}
 
-  if (rk == 75 + 256)  // F9: Reset
-    instrumentReset(1);
 
+// Channel workers pool. Engine thread is worker 0 and also takes channels; free worker takes next channel, so slow one does not hold others.
+pthread_t workerThread[MAXCH];
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+void (*poolJob)(int ch, int worker);
+int poolGen = 0;   // Bumped for each job
+int poolNextCh;    // Next channel to take
+int poolBusy;      // Workers, except engine, still running job
+int poolExit = 0;
 
-  // The following will work for all menu pages.
-  rk = rk % 256;
+void poolWork(int worker)
+{
+  int ch;
+  while ((ch = __atomic_fetch_add(&poolNextCh, 1, __ATOMIC_RELAXED)) < channels)
+    poolJob(ch, worker);
+}
 
-  if ((rk == 23) || (rk == 2)) // Tab, Mouse middle click
-    mkrCh[mkrIsDelta] = (mkrCh[mkrIsDelta] + 1) % channels;
+static void *
+worker_thread (void *arg)
+{
+  int worker = (intptr_t) arg;
+  int gen = 0;
+  traceTid = 10 + worker;
 
-  int direction = 0;
-  int multiplier = 1;
+  pthread_mutex_lock (&pool_lock);
+  while (1)
+  {
+    while ((poolGen == gen) && (! poolExit))
+      pthread_cond_wait (&pool_start, &pool_lock);
+    if (poolExit)
+      break;
+    gen = poolGen;
+    pthread_mutex_unlock (&pool_lock);
 
-  // minus, <-, '-', 'up arrow', PgUp, mouse wheel
-  if ((rk==20) || (rk==82) || (rk==113) || (rk==111) || (rk==112) || (rk == (5 - optRevWheel)))
-    direction = -1;
+    poolWork(worker);
 
-  // plus, ->, '+', 'down arrow', PgDown, mouse wheel
-  if ((rk==21) || (rk==86) || (rk==114) || (rk==116) || (rk==117) || (rk == (4 + optRevWheel)))
-    direction = 1;
+    pthread_mutex_lock (&pool_lock);
+    if (--poolBusy == 0)
+      pthread_cond_signal (&pool_done);
+  }
+  pthread_mutex_unlock (&pool_lock);
 
-  // Marker jog: 'up arrow', PgUp, 'down arrow', PgDown
-  if ((rk==111) || (rk==112) || (rk==116) || (rk==117))
-    multiplier = squeeze ? (stepRel * xSize / xGrids) : 10;
+  return 0;
+}
 
-  if (direction != 0)
-    switch (menu)
-    {
-      case 1:
-        if (strlen(inputStr))
-          break;
+// Run job for all channels, return when all are done.
+void poolRun(void (*job)(int ch, int worker))
+{
+  pthread_mutex_lock (&pool_lock);
+  poolJob = job;
+  poolNextCh = 0;
+  poolBusy = workers - 1;
+  poolGen++;
+  pthread_cond_broadcast (&pool_start);
+  pthread_mutex_unlock (&pool_lock);
+
+  poolWork(0);
+
+  pthread_mutex_lock (&pool_lock);
+  while (poolBusy)
+    pthread_cond_wait (&pool_done, &pool_lock);
+  pthread_mutex_unlock (&pool_lock);
+}
 
-        units = kHz;
+void poolCreate(void)
+{
+  for (intptr_t w = 1; w < workers; w++)
+    pthread_create (&workerThread[w], NULL, worker_thread, (void *) w);
+}
 
-        setCenter(startHz + spanHz / 2 + (spanHz / 10) * direction);
-        break;
+void poolDestroy(void)
+{
+  pthread_mutex_lock (&pool_lock);
+  poolExit = 1;
+  pthread_cond_broadcast (&pool_start);
+  pthread_mutex_unlock (&pool_lock);
 
-      case 2:
-        if (strlen(inputStr))
-          break;
+  for (int w = 1; w < workers; w++)
+    pthread_join (workerThread[w], NULL);
+}
 
-        int span = spanHz;
+// Headless output, -H. Each spectrum of each channel, as Stage 3 stored it, with time of signal at its end.
+// Binary record is header below and 'bins' of int16 levels, dB * intDbScale, NODATA if none; little endian.
+// CSV: header line of bin frequencies when they change, then one line per spectrum and channel: ns, ch, levels in dB.
+typedef struct __attribute__((packed)) // 36 bytes
+{
+  char magic[4];   // "JSAS"
+  uint32_t ch;
+  uint64_t ns;     // Signal time
+  double hz0, dHz; // Frequency of bin 0, and of bin step
+  uint32_t bins;
+} outHeader_t;
+
+FILE *outFile;
+uint64_t outSpectra = 0;
+int outGen = -1;
+int16_t outPad[MAXDATA]; // NODATA row, for bins out of valid range
+
+void outOpen(void)
+{
+  outFile = strcmp(optHeadless, "-") ? fopen(optHeadless, "w") : stdout;
+  if (! outFile)
+    ERR(S, "Can't open '%s': %s.", optHeadless, strerror(errno));
+  for (int i = 0; i < MAXDATA; i++)
+    outPad[i] = NODATA;
+}
 
-        float exponent = pow(10, (int)(log10(span)));
-        float m = span / exponent;
-        if (direction > 0)
-        {
-          if      (m < 2.0)
-            m = 2.0;
-          else if (m < 5.0)
-            m = 5.0;
-          else
-            m = 10.0;
-        }
-        else
-        {
-          if      (m > 5.0)
-            m = 5.0;
-          else if (m > 2.0)
-            m = 2.0;
-          else if (m > 1.0)
-            m = 1.0;
-          else
-            m = 0.5;
-        }
-        span = m * exponent;
-        // TODO review all units manage.
-        (span < 0.1 * kHz) ? (units = Hz) : (units = kHz);
-        setSpan (span);
-        break;
+void outClose(void)
+{
+  if ((outFile) && (outFile != stdout))
+    fclose(outFile);
+  else if (outFile)
+    fflush(outFile);
+}
 
-      case 3:
-        setRbw(- direction);
-        break;
+void outSpectrum(void)
+{
+  // Same as marker frequency, see plotOneChannelMkr().
+  double dHz = squeeze ? stepRel * spanHz / xSize : fsFft / (double)fftSize;
+  double hz0 = squeeze ? startHz + (startHz < 0) * dHz : startHz + deltaHz;
 
-      case 4:
-        setVbw(- direction);
-        break;
+  if ((optCsv) && (outGen != screenGen))
+  {
+    fprintf(outFile, "ns,ch");
+    for (int i = 0; i < cols; i++)
+      fprintf(outFile, ",%.3f", hz0 + i * dHz);
+    fprintf(outFile, "\n");
+    outGen = screenGen;
+  }
 
-      case 5:
-        if (marker[mkrIsDelta] != -1)
-          marker[mkrIsDelta] = FIT(marker[mkrIsDelta] + direction * multiplier, firstUsedBin, lastUsedBin);
-        break;
+  for (int ch = 0; ch < channels; ch++)
+  {
+    trace_t *tr = &trace[memCurr][ch];
+    int16_t *row = TRACE(data, memCurr, ch);
+    int lo = (tr->gen == screenGen) ? tr->lo : cols;
+    int hi = (tr->gen == screenGen) ? tr->hi : -1;
 
-      case 7:
-        setYShift(direction);
-        break;
+    if (optCsv)
+    {
+      fprintf(outFile, "%ld,%d", audioNs, ch);
+      for (int i = 0; i < cols; i++)
+        if ((i < lo) || (i > hi) || (row[i] == NODATA))
+          fputc(',', outFile);
+        else
+          fprintf(outFile, ",%.2f", row[i] / (float)intDbScale);
+      fputc('\n', outFile);
+    }
+    else
+    {
+      outHeader_t h = {"JSAS", ch, audioNs, hz0, dHz, cols};
+      fwrite(&h, sizeof(h), 1, outFile);
+      // Bins out of valid range are not written by Stage 3.
+      int tail = MAX(hi + 1, lo);
+      fwrite(outPad, sizeof(int16_t), MIN(lo, cols), outFile);
+      if (lo <= hi)
+        fwrite(row + lo, sizeof(int16_t), hi - lo + 1, outFile);
+      if (tail < cols)
+        fwrite(outPad, sizeof(int16_t), cols - tail, outFile);
     }
+  }
+  outSpectra++;
+}
 
-  if (rk == 110) // 'home'
-    if ((menu == 5) && (marker[mkrIsDelta] != -1))
-      marker[mkrIsDelta] = firstUsedBin;
+static void *
+disk_thread (void *arg)
+{
+  jack_thread_info_t *info = (jack_thread_info_t *) arg;
+  bufSize = (1 << MAX(maxFFTK, 16)) * jackPorts * sample_size_4bytes * 1;
+  buf = calloc (bufSize, 1);
+  uint64_t bufPointer = 0;
+  uint64_t readSpace;
+  int chunksToRead;
+  bufSizeInSamples = bufSize / sample_size_4bytes;
 
-  if (rk == 115) // 'end'
-    if ((menu == 5) && (marker[mkrIsDelta] != -1))
-      marker[mkrIsDelta] = lastUsedBin;
+  pthread_mutex_lock (&disk_thread_lock);
+  info->status = 0;
+  jackPorts = info->channels;
 
-  if (rk == 9) // Esc
-    instrumentReset(0);
+  poolCreate();
 
-  if (rk == 53) // 'x' aka Ctrl+x
+  void checkReadSpace()
   {
-    menu = 0;
-    sprintf(resultStr, "Exit.");
-    programExit = 1;
+    if ((info->can_capture) && (! programExit))
+    {
+      readSpace = jack_ringbuffer_read_space (rb);
+      chunksToRead = readSpace / chunkSize;
+      // Headless writes each spectrum, so each chunk is FFT of its own; display needs only the most recent one.
+      if (optHeadless)
+        chunksToRead = MIN(chunksToRead, 1);
+      rollPos = fmod((rollPhase + readSpace / (float)chunkSize) / roll, 1.0);
+    }
+    else
+      chunksToRead = 0;
   }
 
-  if (rk == 76) // F10
-    menuPage = (menuPage + 1) % 3;
-  else
+  // Let display thread take state lock, if it waits for it to process input.
+  void engineYield()
   {
-    if (menuPage == 1)
-      menuPage = menu = 0;
+    if (uiPending)
+    {
+      pthread_mutex_unlock (&state_lock);
+      renderWake();
+      while ((uiPending) && (! programExit))
+        usleep(100);
+      pthread_mutex_lock (&state_lock);
+    }
+  }
 
-    rePlot = 1;
+  // Run stage for all channels: on workers pool, or one by one, yielding between channels.
+  void channelsRun(void (*job)(int ch, int worker))
+  {
+    if (workers > 1)
+      poolRun(job);
+    else
+      for (int ch = 0; ch < channels; ch++)
+      {
+        job(ch, 0);
+        if (! stopped)
+          engineYield();
+        if (discardCurrentFft)
+          break;
+      }
   }
 
-  plotBottomHelp();
-  printParam();
+  // Main loop. State lock is held while we process, and released between frames and channels.
+  while (1)
+  {
+    lowCpu = 0;
 
-  DBV(X, "Menu %d ", menu);
-}
+    pthread_mutex_lock (&state_lock);
+    goto start;
+
+    while (chunksToRead > 0)
+    {
+      discardCurrentFft = 0;
 
+      uint64_t t = nsNow();
+      uint64_t gap = bufSize - bufPointer; // bytes before end of buf
+      uint64_t newFrames = chunkSize * chunksToRead / (jackPorts * sample_size_4bytes);
 
-void processMessages()
-{
-  while(XPending(dpy))
-  {
-    DBV(X, "Keyboard, mouse or X11 process.");
+      if (gap < chunkSize * chunksToRead)
+      {
+        jack_ringbuffer_read (rb, buf + bufPointer, gap);
+        bufPointer = chunkSize * chunksToRead - gap;
+        jack_ringbuffer_read (rb, buf + 0, bufPointer);
+      }
+      else if (gap == chunkSize * chunksToRead)
+      {
+        jack_ringbuffer_read (rb, buf + bufPointer, chunkSize * chunksToRead);
+        bufPointer = 0;
+      }
+      else
+      {
+        jack_ringbuffer_read (rb, buf + bufPointer, chunkSize * chunksToRead);
+        bufPointer = bufPointer + chunkSize * chunksToRead;
+      }
 
-    XEvent e;
-    XNextEvent(dpy, &e);
+      timerAdd(T_READ, t, -1);
+      audioNs += chunksToRead * fftPlotTime / roll * 1e9;
 
-    if (e.type == ClientMessage)
-      if ((Atom)e.xclient.data.l[0] == wm_delete_window) // [14] [15]
+      rollPhase = (rollPhase + chunksToRead) % roll;
+
+      bufReadoutPointer = bufPointer - fftSize * jackPorts * sample_size_4bytes;
+      if (bufReadoutPointer < 0)
+        bufReadoutPointer = bufReadoutPointer + bufSize;
+
+      planNum = fftSizeK - MINFFTK;
+      if KFR
+        tmpGrow(tmpNeed[planNum]);
+
+      if (zoomD > 1)
       {
-        DBG(X, "Close window signal received.");
-        programExit = 1;
+        // Zoom restarts from history we still have in buf, so picture does not wait for decimated samples to come.
+        uint64_t bufFrames = bufSizeInSamples / jackPorts;
+        // Larger FFT needs larger decimated ring, and its samples anyway.
+        if ((zoomGenSeen != zoomGen) || (zoom[0].ringSize < fftSize))
+        {
+          for (int ch = 0; ch < channels; ch++)
+            zoomReset(&zoom[ch]);
+          newFrames = MAX(newFrames, (fftSize + HBTAPS) * zoomD);
+          zoomGenSeen = zoomGen;
+        }
+        zoomFrames = MIN(newFrames, bufFrames);
+        zoomFrom = (bufPointer / sample_size_4bytes + bufSizeInSamples - zoomFrames * jackPorts) % bufSizeInSamples;
+        channelsRun(zoomFeed);
+        // Channels are fed partially, start again.
+        if (discardCurrentFft)
+          zoomGenSeen = -1;
+        // Not enough decimated samples yet.
+        if ((zoom[0].count < fftSize) || (discardCurrentFft))
+          goto skip;
       }
 
-    if (e.type == Expose)
-      XFlushArea(0, 0, winW, winH);
+      if ((memAddScheduled) || ((phosphor > 0) && (phosphor < MAXPHOSPHOR)))
+      {
+        memCurr = (memCurr + 1) % MAXMEM;
 
-    if (e.type == KeyPress)
-      processKeyboard(e.xkey.keycode);
+        if (memAddScheduled)
+          memQty = MIN(memQty + 1, memorySlots + 1);
 
-    if (e.type == ButtonPress)
-    {
-      if ((e.xbutton.button == Button2) || (e.xbutton.button > Button3))
-        // Mouse wheel gives 4 or 5, good for keyboard mimic: X11 keyboard codes are starts from 8.
-        processKeyboard(e.xbutton.button);
+        memAddScheduled = 0;
+      }
+
+      if ((optBatch) && (zoomD == 1))
+      {
+        // All channels windowed, then one FFT for all, then all post-processed.
+        channelsRun(channelWindow);
+        if (! discardCurrentFft)
+          channelsFftBatch();
+        if (! discardCurrentFft)
+          channelsRun(channelPost);
+      }
       else
-        processMouse((int)(e.xbutton.x / glScale - DX), (int)(e.xbutton.y / glScale - DY), (e.xbutton.button != Button1));
-    }
-  }
-}
+        channelsRun(fftExecuteAndProcessOneChannel);
 
+      timersCommit(T_READ, T_POST);
+      traceOverrunsCounter();
 
-// JACK threads.
-typedef struct _thread_info
-{
-  pthread_t thread_id;
-  jack_nframes_t rb_size;
-  jack_client_t *client;
-  unsigned int channels;
-  volatile int can_capture;
-  volatile int can_process;
-  volatile int status;
-} jack_thread_info_t;
+      if ((density) && (! stopped) && (! discardCurrentFft))
+      {
+        int e = densHead % DENSRING;
+        densGenOf[e] = screenGen;
+        densDt[e] = chunksToRead * fftPlotTime / roll;
+        __atomic_store_n(&densHead, densHead + 1, __ATOMIC_RELEASE);
+      }
 
-/* JACK data */
-unsigned int nports = 0;
-jack_port_t **ports = NULL;
-jack_default_audio_sample_t **jack_in = NULL;
-jack_nframes_t nframes;
+      if (((! stopped) || (rePlot)) && (! discardCurrentFft))
+      {
+        if (optHeadless)
+          outSpectrum();
+        else
+          framePublish();
+
+        if ((phosphor > 0) && (phosphor < MAXPHOSPHOR))
+          memQty = MIN(memQty + 1, phosphor + 1);
+
+        memPrev = memCurr;
+        vbwContinue = 1;
+
+        rePlot = 0;
+      }
+
+ skip:
+      lowCpu = 1;
+      engineYield();
+ start:
+      checkReadSpace();
+    }
 
-/* Synchronization between process thread && disk thread. */
-jack_ringbuffer_t *rb = NULL;
-pthread_mutex_t disk_thread_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t data_ready = PTHREAD_COND_INITIALIZER;
-uint64_t overruns = 0;
-jack_client_t *client = NULL;
+    pthread_mutex_unlock (&state_lock);
 
-static void *
-disk_thread (void *arg)
-{
-  jack_thread_info_t *info = (jack_thread_info_t *) arg;
-  uint64_t bufSize = (1 << MAX(maxFFTK, 16)) * jackPorts * sample_size_4bytes * 1;
-  void *buf = calloc (bufSize, 1);
-  uint64_t bufPointer = 0;
-  uint64_t readSpace;
-  int chunksToRead;
-  int64_t bufReadoutPointer;
-  uint64_t bufSizeInSamples = bufSize / sample_size_4bytes;
-  int planNum;
+    if (programExit)
+      break;
 
-  pthread_mutex_lock (&disk_thread_lock);
-  info->status = 0;
-  jackPorts = info->channels;
+    /* wait until process() signals more data */
+    pthread_cond_wait (&data_ready, &disk_thread_lock);
+  }
 
-  void fftExecuteAndProcessOneChannel(int ch)
-  {
-    ch = ch % MAXCH;
-    inmin[ch] = 0.0;
-    inmax[ch] = 0.0;
+  pthread_mutex_unlock (&disk_thread_lock);
+  poolDestroy();
+  free (buf);
 
-    // Stage 1: Pre-process FFT data:
-    // * Gathering;
-    // * Windowing;
-    // * Amplitude Zero, Min, Max checks.
-    double Min = inmin[ch];
-    double MinNZ = inminAbsNonzero[ch];
-    double Max = inmax[ch];
+  return 0;
+}
 
-    uint8_t winNum = fftWindow[ch] % MAXWIN;
+// Benchmark, -Y. Stage 1, 2 and 3 are timed on synthetic input over FFT sizes, channels and windows. Backend, fftw3
+// jobs, real / complex input and batched / per-channel FFT are set once per process (threads, plans and buffers depend
+// on them), so each such configuration runs in forked child, which reports lines through pipe; parent prints table and
+// writes JSON. -t, -j, -i and -B, when given, fix their axis.
+char *optBench = NULL; // JSON file
+int benchFix = 0;      // Bits: 1 type, 2 jobs, 4 IQ, 8 batch
+int benchFd = -1;      // Child: write end of pipe
+char *fftTypeStr[4] = {"fftw3 double", "kfr double", "fftw3 float", "kfr float"};
+
+// Synthetic input (noise and tone on all ports, so any stride reads valid samples) and full band state.
+void benchInit(int maxCh)
+{
+  bufSizeInSamples = (1UL << maxFFTK) * maxCh * (optIQ + 1);
+  buf = malloc(bufSizeInSamples * sample_size_4bytes);
+  for (uint64_t i = 0; i < bufSizeInSamples; i++)
+    ((float *)buf)[i] = 0.5 * sin(i * 0.01) + 1e-3 * (rand() / (float)RAND_MAX - 0.5);
+  bufReadoutPointer = 0;
+
+  memCurr = memPrev = 0;
+  vbw = 1;
+  startHz = optIQ ? - sampleRate / 2 : 0;
+  spanHz = optIQ ? sampleRate : sampleRate / 2;
+  fsFft = sampleRate;
+  zoomD = 1;
+  zoomHz = 0;
+}
 
-    uint64_t bufReadoutSamplePointer = bufReadoutPointer / sample_size_4bytes;
+// Engine state for FFT size 2^k, as newFft() makes it; plan is built if not yet.
+void benchSetup(int k)
+{
+  planNum = k - MINFFTK;
+  fftSizeK = k;
+  fftSize = 1UL << k;
 
-#ifdef straight
-    // This one can't be vectorized, because sample is not known each next cycle.
-// TODO add i,q! NOTE
-    for (uint64_t i = 0; i < fftSize; i++)
-    {
-      double sample;
+  stepAbs = fsFft * xSize / (float)spanHz / (float)fftSize;
+  stepRel = MINSTEP;
+  while ((stepRel < fmax(MINSTEP, stepAbs)) && (stepRel < MAXSTEP))
+    stepRel = stepRel * 2.0;
+  plotSamplesNum = (int)((float)fftSize * (float)spanHz / fsFft);
+  squeeze = (plotSamplesNum < xSize) ? 0 : 1;
+  columnsCalc();
 
-      // NOTE Here is point of loss of precision: JACK is float.
-      sample = ((float *)buf)[bufReadoutSamplePointer + ch];
+  if (! planReady[planNum])
+  {
+    planBuild(planNum);
+    planReady[planNum] = 1;
+  }
+}
 
-      bufReadoutSamplePointer = bufReadoutSamplePointer + channels;
-      // Should never be >, only ==, but still.
-      if (bufReadoutSamplePointer >= bufSizeInSamples)
-        bufReadoutSamplePointer = 0;
+// Stage 1, 2 and 3 ns of one spectrum of chn channels, with their windows: one warm up, then until 10 ms are spent.
+void benchTime(int chn, double *ns)
+{
+  uint64_t sum[3] = {0, 0, 0}, reps = 0;
 
-      if (1)
-        // We use only left half of window, then mirroring it.
-        if (i < (fftSize / 2))
-          fftinR[ch][i] = sample * windowfunc[planNum][winNum][i];
-        else
-          fftinR[ch][i] = sample * windowfunc[planNum][winNum][fftSize - 1 - i];
-      else
-        fftinR[ch][i] = sample; // When window = NoWindow
+  channels = chn;
+  jackPorts = chn * (optIQ + 1);
+  windowsEnsure(planNum);
+  if KFR
+    tmpGrow(tmpNeed[planNum]);
 
-      Min = fmin(Min, sample);
-      Max = fmax(Max, sample);
-      if (sample != 0)
-        MinNZ = fmin(MinNZ, fabs(sample));
-    }
-#else
-    // This one can be vectorized. Nobody knows how efficient is this anyway, we added extra re-read of array.
-    // -g -O3 -mavx2 -ffast-math -fopt-info-vec-optimized -march=native
-    if (optIQ)
+  for (uint64_t t0 = nsNow(), t; (reps < 2) || (nsNow() - t0 < 10000000UL); reps++)
+    if (optBatch)
     {
-      // 1. Deserialize first.
-      for (uint64_t i = 0; i < fftSize; i++)
-      {
-        double sampleI, sampleQ;
-
-        // NOTE Here is point of loss of precision: JACK is float.
-        sampleI = ((float *)buf)[bufReadoutSamplePointer + ch * 2];
-        sampleQ = ((float *)buf)[bufReadoutSamplePointer + ch * 2 + 1];
-
-        bufReadoutSamplePointer = bufReadoutSamplePointer + jackPorts;
-        // Should never be >, only ==, but still.
-        if (bufReadoutSamplePointer >= bufSizeInSamples)
-          bufReadoutSamplePointer = 0;
-
-        fftin[ch][i][0] = sampleI;
-        fftin[ch][i][1] = sampleQ;
-
-        Min = fmin(Min, sampleI);
-        Min = fmin(Min, sampleQ);
-        Max = fmax(Max, sampleI);
-        Max = fmax(Max, sampleQ);
-        if (sampleI != 0)
-          MinNZ = fmin(MinNZ, fabs(sampleI));
-        if (sampleQ != 0)
-          MinNZ = fmin(MinNZ, fabs(sampleQ));
-      }
-      // 2a. Apply half of window (forth)...
-      for (uint64_t i = 0; i < (fftSize / 2); i++)
-      {
-        fftin[ch][i][0] = fftin[ch][i][0] * windowfunc[planNum][winNum][i];
-        fftin[ch][i][1] = fftin[ch][i][1] * windowfunc[planNum][winNum][i];
-      }
-      // 2b. ... then apply another half of window (backwards).
-      for (uint64_t i = (fftSize / 2); i < fftSize; i++)
+      // As engine does with -B: all windows, one FFT of all channels, all posts. Plan is of chn channels.
+      t = nsNow();
+      for (int ch = 0; ch < chn; ch++)
+        channelWindow(ch, 0);
+      uint64_t t1 = nsNow();
+      channelsFftBatch();
+      uint64_t t2 = nsNow();
+      for (int ch = 0; ch < chn; ch++)
+        channelPost(ch, 0);
+      if (reps)
       {
-        fftin[ch][i][0] = fftin[ch][i][0] * windowfunc[planNum][winNum][fftSize-1 - i];
-        fftin[ch][i][1] = fftin[ch][i][1] * windowfunc[planNum][winNum][fftSize-1 - i];
+        sum[0] += t1 - t;
+        sum[1] += t2 - t1;
+        sum[2] += nsNow() - t2;
       }
     }
     else
-    {
-      // 1. Deserialize first.
-      for (uint64_t i = 0; i < fftSize; i++)
+      for (int ch = 0; ch < chn; ch++)
       {
-        double sample;
+        t = nsNow();
+        channelWindow(ch, 0);
+        uint64_t t1 = nsNow();
+        channelFft(ch, 0);
+        uint64_t t2 = nsNow();
+        channelPost(ch, 0);
+        if (reps)
+        {
+          sum[0] += t1 - t;
+          sum[1] += t2 - t1;
+          sum[2] += nsNow() - t2;
+        }
+      }
 
-        // NOTE Here is point of loss of precision: JACK is float.
-        sample = ((float *)buf)[bufReadoutSamplePointer + ch];
+  for (int i = 0; i < 3; i++)
+    ns[i] = sum[i] / (double)(reps - 1);
+}
 
-        bufReadoutSamplePointer = bufReadoutSamplePointer + jackPorts;
-        // Should never be >, only ==, but still.
-        if (bufReadoutSamplePointer >= bufSizeInSamples)
-          bufReadoutSamplePointer = 0;
+// Child: runs after Init FFT, with channels = MAXCH buffers; never returns.
+void benchRun(void)
+{
+  FILE *out = fdopen(benchFd, "w");
+  int maxCh = channels;
 
-        fftinR[ch][i] = sample;
+  benchInit(maxCh);
+  dataBins = MIN((int)(xSize / MINSTEP) + 1, MAXDATA);
+  data = calloc(MAXMEM * maxCh * dataBins, sizeof(int16_t));
 
-        Min = fmin(Min, sample);
-        Max = fmax(Max, sample);
-        if (sample != 0)
-          MinNZ = fmin(MinNZ, fabs(sample));
+  for (int k = MINFFTK; k <= maxFFTK; k++)
+  {
+    benchSetup(k);
+    for (int chn = 1; chn <= maxCh; chn *= 2)
+      for (int w = 0; w < MAXWIN; w++)
+      {
+        double ns[3];
+        for (int ch = 0; ch < MAXCH; ch++)
+          fftWindow[ch] = w;
+        // Batched plan is of its channel count, so it is made for each.
+        if ((optBatch) && (! w))
+        {
+          if (SINGLE)
+            fftwf_destroy_plan(plan_batchf[planNum]);
+          else
+            fftw_destroy_plan(plan_batch[planNum]);
+          channels = chn;
+          planBuild(planNum);
+        }
+        benchTime(chn, ns);
+        fprintf(out, "%d %d %d %d %d %d %d %.1f %.1f %.1f\n", optType, jobs, optIQ, optBatch, k, chn, w, ns[0], ns[1],
+            ns[2]);
+        fflush(out);
       }
-      // 2a. Apply half of window (forth)...
-      for (uint64_t i = 0; i < (fftSize / 2); i++)
-        fftinR[ch][i] = fftinR[ch][i] * windowfunc[planNum][winNum][i];
-      // 2b. ... then apply another half of window (backwards).
-      for (uint64_t i = (fftSize / 2); i < fftSize; i++)
-        fftinR[ch][i] = fftinR[ch][i] * windowfunc[planNum][winNum][fftSize - 1 - i];
-    }
+  }
 
-#endif
+  channels = maxCh;
+  free(buf);
+  fclose(out);
+  exit(0);
+}
 
-    inmin[ch] = fmin(Min, inmin[ch]);
-    inminAbsNonzero[ch] = fmin(MinNZ, inminAbsNonzero[ch]);
-    inmax[ch] = fmax(Max, inmax[ch]);
+// Parent: forks child per configuration and collects results. Child returns here, with configuration set.
+void benchMain(void)
+{
+  FILE *json = fopen(optBench, "w");
+  if (! json)
+    ERR(S, "Can't open '%s': %s.", optBench, strerror(errno));
+  fprintf(json, "[");
+  int rows = 0;
+
+  printf("%-12s %4s %2s %2s %8s %2s %-7s %10s %10s %10s %10s\n", "type", "jobs", "iq", "b", "fft", "ch", "window",
+      "win ns/S", "fft ns/S", "post ns/S", "fps");
+
+  for (int type = 0; type < 4; type++)
+    for (int j = 1; j <= 4; j *= 2)
+      for (int iq = 0; iq < 2; iq++)
+        for (int b = 0; b < 2; b++)
+        {
+          if (((benchFix & 1) && (type != optType)) || ((benchFix & 2) && (j != jobs)) || ((benchFix & 4) && (iq != optIQ))
+              || ((benchFix & 8) && (b != optBatch)))
+            continue;
+          // kfr has no threads of its own, and no batched plans.
+          if ((type & 1) && ((j > 1) || (b)))
+            continue;
+
+          int fd[2];
+          if (pipe(fd))
+            ERR(S, "pipe(): %s.", strerror(errno));
+          fflush(stdout);
+          pid_t pid = fork();
+          if (pid < 0)
+            ERR(S, "fork(): %s.", strerror(errno));
+
+          if (! pid)
+          {
+            fclose(json);
+            close(fd[0]);
+            benchFd = fd[1];
+            optType = type;
+            jobs = j;
+            optIQ = iq;
+            optBatch = b;
+            channels = MAXCH;
+            jackPorts = channels * (optIQ + 1);
+            optZoom = 0;
+            return;
+          }
 
-    if ((inmin[ch] < -1.0) || (inmax[ch] > 1.0))
-      amptOverload = ch;
+          close(fd[1]);
+          FILE *in = fdopen(fd[0], "r");
+          int t, jb, i, bt, k, ch, w;
+          double ns[3];
+          while (fscanf(in, "%d %d %d %d %d %d %d %lf %lf %lf", &t, &jb, &i, &bt, &k, &ch, &w, &ns[0], &ns[1], &ns[2]) == 10)
+          {
+            double samples = (double)(1UL << k) * ch;
+            double fps = 1e9 / (ns[0] + ns[1] + ns[2]);
+            printf("%-12s %4d %2d %2d %8ld %2d %-7s %10.3f %10.3f %10.3f %10.1f\n", fftTypeStr[t], jb, i, bt, 1UL << k, ch,
+                fftWindowStr[w], ns[0] / samples, ns[1] / samples, ns[2] / samples, fps);
+            fprintf(json, "%s\n {\"type\": \"%s\", \"jobs\": %d, \"iq\": %d, \"batch\": %d, \"fft\": %ld, \"channels\": %d, \"window\": \"%s\", "
+                "\"ns_per_sample\": {\"window\": %.4f, \"fft\": %.4f, \"post\": %.4f}, \"fps\": %.2f}", rows++ ? "," : "",
+                fftTypeStr[t], jb, i, bt, 1UL << k, ch, fftWindowStr[w], ns[0] / samples, ns[1] / samples, ns[2] / samples, fps);
+          }
+          fclose(in);
+
+          int status;
+          waitpid(pid, &status, 0);
+          if ((! WIFEXITED(status)) || (WEXITSTATUS(status)))
+            WRN(S, "Bench of %s, jobs %d, iq %d, batch %d failed.", fftTypeStr[type], j, iq, b);
+        }
 
-    // Exact match is rare thing, but we behave as precise as possible. Good to check if our samples were not scaled on the road.
-    if ((inmin[ch] == -1.0) || (inmax[ch] == 1.0))
-      amptMax = ch;
+  fprintf(json, "\n]\n");
+  fclose(json);
+  MSG(S, "Bench: %d results written to '%s'.", rows, optBench);
+  exit(0);
+}
 
-    if (inmax[ch] == 0.0)
-      amptZero = ch;
 
-    // Stage 2: Do FFT.
-    if (! stopped)
-    {
-      DBV(F, "Ch. %d Started fft plan execute.", ch);
+// Display thread: X11 or openGL plot of most recent published frame, and user input.
+pthread_t render_thread_id;
 
-      if (optType)
-        if (optIQ)
-          kfr_dft_execute_f64(plan_kfr[planNum], fftout[ch][0], fftin[ch][0], tmp);
-        else
-          kfr_dft_real_execute_f64(plan_kfr_real[planNum], fftout[ch][0], fftinR[ch], tmp);
-      else
-        fftw_execute(plan_fftw[planNum][ch]);
+void plotProgressbar()
+{
+  if ((! (windowBits & (16 + 64))) && (fftsPerSecond < 1))
+  {
+    int w = 3;
+    XFillRectangle(dpy, pm, bgColor, DX, DY - mkrSize - w, xSize, w);
 
-      DBV(F, "Ch. %d Finished fft plan execute.", ch);
-    }
+    for (int i = 0; i < (rollPos * xSize); i++)
+      XDrawPoint(dpy, pm, fontColor[2], DX + i, DY - mkrSize - i % w - 1);
 
-    // Stage 3: Post-process FFT result:
-    // * Convert complex (i, q) data to power;
-    // * Averaging;
-    // * Leveling, include Window Noise Figure (NF) apply;
-    // * Fit FFT bins to screen bins;
-    // * Translate to screen's dB;
-    // * Apply video filter;
-    // * Store to data array to allow multiple reuse it.
-    double winNFbins = 1.0;
-    if AVERAGE
-      winNFbins = fftWindowNFbins[fftWindow[ch]];
+    XFlushArea(DX, DY - mkrSize - w, xSize, w);
+  }
+}
 
-    double coe0 = 10.0 * intDbScale / (double)(2 - isDbPwr);
-    double coe1 = log10(1.0 / ((double)fftSize / (double)(2 - optIQ))) * 2.0 + log10(1.0 / winNFbins);
+void plotFrame()
+{
+  uint64_t t = nsNow();
+  if (optShm)
+    swBegin();
+  else
+    newPlot();
 
-    void storeBin(int bin, double power)
+  if (optOpengl)
+  {
+    // Phase 1. Plot screen base (grid, legend...), it is uploaded as texture only when pm was changed.
+    if (! baseTex)
     {
-      int fftDb = MAX(roundf(coe0 * (power + coe1)), NODATA + 1);
-      // Our video filter is per-point IIR LPF.
-      // Note: video filter can't work when stopped; it is run time thing.
-      if ((vbw > 1) && (vbwContinue))
-        data[memCurr][bin][ch] = (fftDb + data[memPrev][bin][ch] * (vbw - 1)) / (float)vbw;
-      else if ((vbw == 0) && (vbwContinue)) // Max hold
-        data[memCurr][bin][ch] = MAX(fftDb, data[memPrev][bin][ch]);
-
-      else
-        data[memCurr][bin][ch] = fftDb;
+      glGenTextures(1, &baseTex);
+      glBindTexture(GL_TEXTURE_2D, baseTex);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, winW, winH, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+      baseDirty(0, 0, winW, winH);
     }
+    glBindTexture(GL_TEXTURE_2D, baseTex);
 
-    // It allow even more correct markers near center, while anyway they will be approximate unless zoomed-in well (narrower span to exact view).
-    // float centeringShift = (squeeze) ? (fmod((((double)spanHz / 2.0 + ((startHz < 0) ? - startHz : 0)) * (double)fftSize / (double)sampleRate) - 1.0, 2.0) - 0.5) : 0;
-    float centeringShift = 0;
-
-    int firstSampleOffset = (int)(startHz * (float)fftSize / (float)sampleRate + centeringShift);
-    int bins = 0;
-    double fftPowerBin = -1e6;
-    firstUsedBin = -1;
-    lastUsedBin = 0;
-    for (int sample = 0; sample <= (plotSamplesNum + 1); sample++)
+    int x0 = MAX(dirtyX0, 0), y0 = MAX(dirtyY0, 0);
+    int x1 = MIN(dirtyX1, winW), y1 = MIN(dirtyY1, winH);
+    if ((x1 > x0) && (y1 > y0))
     {
-      int bin = squeeze ? (int)(sample * stepAbs / stepRel) : sample;
-// if (sample == plotSamplesNum) printf("ch %d plotSamplesNum %d bin %d\n", ch, plotSamplesNum, bin);
-      int sampleAbs = sample + firstSampleOffset;
+      XImage *xim;
+      xim = XGetImage(dpy, pm, x0, y0, x1 - x0, y1 - y0, AllPlanes, ZPixmap);
+      if (! xim)
+          ERR(X, "XGetImage() failed.");
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, xim->bytes_per_line / 4);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_BGRA, GL_UNSIGNED_BYTE, (void*)(&(xim->data[0])));
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      XDestroyImage(xim);
+    }
+    dirtyX0 = dirtyX1 = 0;
+
+    glLoadIdentity();
+    glOrtho(0, winW, 0, winH, -1.0, 1.0);
+    glBlendFunc(GL_ONE, GL_ZERO); // Disable blending.
+    // Same as glDrawPixels() with glPixelZoom(glScale, - glScale): upside down, scaled.
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE); // Not tinted by ray color.
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(0, winH);
+    glTexCoord2f(1, 0); glVertex2f(winW * glScale, winH);
+    glTexCoord2f(1, 1); glVertex2f(winW * glScale, winH - winH * glScale);
+    glTexCoord2f(0, 1); glVertex2f(0, winH - winH * glScale);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+
+    // Phase 2. Plot spectrograms
+    // We have special 0.5 px shifts, and turn it upside down, to exact match openGL lines with X11.
+    glLoadIdentity();
+    glOrtho(0 - 0.5, winW / glScale - 0.5, winH / glScale - 0.5, 0 - 0.5, -1.0, 1.0);
+    // glEnable(GL_COLOR_LOGIC_OP);
+    // glLogicOp(GL_OR); // It also works like GXor.
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_COLOR); // Like GXor or better.
+  }
 
-      // For real input: The output is n/2+1 complex numbers. [6]
-      // For complex input: The output should be just n.
-      if ((sampleAbs >= (optIQ ? -((int)fftSize / 2) : 0)) && (sampleAbs <= ((int)fftSize / 2)))
-      {
-        if (sampleAbs < 0)
-          // Note, for complex input, we plot Nyquist point twice, at start and end of plot: so we have symmetrical n+1 point plot, while fftw gives us n point output.
-          sampleAbs += fftSize;
+  timerAdd(T_BASE, t, -1);
+  t = nsNow();
 
-        if (firstUsedBin == -1)
-          firstUsedBin = bin;
+  if (optGlCore)
+    trUpload();
 
-        // fftout[] is double.
-        double fftouti = fftout[ch][sampleAbs][0];
-        double fftoutq = fftout[ch][sampleAbs][1];
+  if (density)
+    densityPlot();
+  else
+    for (int ch = 0; ch < channels; ch++)
+      plotOneChannel(ch);
 
-        if ((fftouti == 0) && (fftoutq == 0))
-          data[memCurr][bin][ch] = NODATA + optShowZero;
-        else
-        {
-          double fftPower = log10(fftouti*fftouti + fftoutq*fftoutq);
+  if (wfRows)
+    waterfallPlot();
 
-          if (! squeeze)
-          {
-            // Exact value.
-            storeBin(bin, fftPower);
-          }
-          else
-          {
-            // First, we store collected bin (if any) if switch to next bin.
-            if ((lastUsedBin == (bin - 1)) && (bins > 0))
-            {
-              storeBin(lastUsedBin, fftPowerBin);
-              fftPowerBin = -1e6;
-              bins = 0;
-            }
-            // More data compress to less video is not easy, uses bins, and can be bin averaging or max method, but not interpolate. See also [1]:p.17, "Note that the averaging must be done with the power spectrum (PS) [...], not with their square roots.
-            if AVERAGE
-              fftPowerBin = (fftPower + fftPowerBin * bins) / (bins + 1);
-            else
-              fftPowerBin = fmaxl(fftPower, fftPowerBin);
-
-            bins += 1;
-          }
-        }
-        lastUsedBin = bin;
-      }
-    }
-    // Finally, we store last collected bin, if any.
-    if (bins > 0)
-      storeBin(lastUsedBin, fftPowerBin);
+  if (optGlCore)
+    trFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  // Status lines go over traces image.
+  if (optShm)
+  {
+    swPut();
+    newPlot();
   }
 
-  void readSpaceAndDrawProgressbar()
+  // Phase 3. Plot markers on top of all.
+  if (optOpengl)
   {
-    if ((info->can_capture) && (! programExit))
-    {
-      readSpace = jack_ringbuffer_read_space (rb);
-      chunksToRead = readSpace / chunkSize;
+    glLoadIdentity();
+    glOrtho(0, winW, 0, winH, -1.0, 1.0);
+  }
 
-      if ((! (windowBits & (16 + 64))) && (fftsPerSecond < 1))
-      {
-        int w = 3;
-        XFillRectangle(dpy, pm, bgColor, DX, DY - mkrSize - w, xSize, w);
-        float rollPos = fmod((rollPhase + readSpace / (float)chunkSize) / roll, 1.0);
+  plotOneChannelMkr(mkrCh[0], 0);
+  plotOneChannelMkr(mkrCh[1], 1);
 
-        for (int i = 0; i < (rollPos * xSize); i++)
-          XDrawPoint(dpy, pm, fontColor[2], DX + i, DY - mkrSize - i % w - 1);
+  timerAdd(T_PLOT, t, -1);
+  t = nsNow();
 
-        XFlushArea(DX, DY - mkrSize - w, xSize, w);
-      }
-    }
-    else
-      chunksToRead = 0;
+  if (! optOpengl)
+    XFlushArea(PLOTAREA);
+  else
+    glXSwapBuffers(dpy, win);
+
+  timerAdd(T_FLUSH, t, -1);
+  timersCommit(T_BASE, T_FLUSH);
+
+  // Timers page is refreshed at readable rate.
+  if ((optTiming) && (nsNow() - legendTimingNs > 250000000UL))
+  {
+    legendTiming();
+    XFlushArea(winW - LEGENDWIDTH, legendTimingY, LEGENDWIDTH, winH - legendTimingY);
   }
+}
+
+static void *
+render_thread (void *arg)
+{
+  traceTid = 2;
 
   if (optOpengl) {
     if (! glXMakeCurrent(dpy, win, glcontext))
@@ -1860,181 +4532,528 @@ disk_thread (void *arg)
 
     glEnable(GL_BLEND);
     glViewport(0, 0, winW, winH);
+
+    if (optGlCore)
+      trInit();
   }
 
-  // Main loop.
-  while (1)
+  pthread_mutex_lock (&render_lock);
+
+  while (! programExit)
   {
-    lowCpu = 0;
-    goto start;
+    processMessages();
+    plotProgressbar();
 
-    while (chunksToRead > 0)
+    frame_t *f = frameTake();
+    if (f)
     {
-      discardCurrentFft = 0;
+      shown = f;
+      // Frames made before last screen clear are not valid for current scales.
+      if (f->gen == screenGen)
+        plotFrame();
+    }
+    else
+    {
+      // Wait for next frame, but keep input alive.
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += 20000000L;
+      if (ts.tv_nsec >= 1000000000L)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait (&frame_ready, &render_lock, &ts);
+    }
+  }
 
-      uint64_t gap = bufSize - bufPointer; // bytes before end of buf
+  pthread_mutex_unlock (&render_lock);
 
-      if (gap < chunkSize * chunksToRead)
+  if (optOpengl)
+  {
+    if (baseTex)
+      glDeleteTextures(1, &baseTex);
+    if (atlasTex)
+      glDeleteTextures(1, &atlasTex);
+    if (densTex)
+      glDeleteTextures(1, &densTex);
+    if (wfTex)
+      glDeleteTextures(1, &wfTex);
+    trDestroy();
+    glXDestroyContext(dpy, glcontext);
+    glXMakeCurrent(dpy, None, NULL);
+  }
+
+  return 0;
+}
+
+
+// Interleave planar port buffers into ringbuffer write vector, frame by frame as disk_thread expects, but with plain copies instead of one jack_ringbuffer_write() per sample. Only whole frames are written, so channels can't slip against each other on overrun.
+static jack_nframes_t
+capture_write (jack_default_audio_sample_t **in, jack_nframes_t n_frames)
+{
+  jack_ringbuffer_data_t vec[2];
+  jack_ringbuffer_get_write_vector (rb, vec);
+
+  uint64_t frameBytes = nports * sample_size_4bytes;
+  jack_nframes_t fit = MIN(n_frames, (vec[0].len + vec[1].len) / frameBytes);
+
+  // Write vector is split at ringbuffer end, so one frame can be split too. Samples are never split.
+  uint64_t split = vec[0].len / sample_size_4bytes;
+  float *head = (float *) vec[0].buf;
+  float *tail = (float *) vec[1].buf;
+
+  for (unsigned chn = 0; chn < nports; chn++)
+  {
+    jack_default_audio_sample_t *src = in[chn];
+    // Frames whose sample of this channel still fits before split.
+    jack_nframes_t n = (split > chn) ? MIN(fit, (split - chn + nports - 1) / nports) : 0;
+    jack_nframes_t i;
+
+    for (i = 0; i < n; i++)
+      head[i * nports + chn] = src[i];
+    for (; i < fit; i++)
+      tail[i * nports + chn - split] = src[i];
+  }
+
+  jack_ringbuffer_write_advance (rb, fit * frameBytes);
+  return fit;
+}
+
+static int
+jack_process (jack_nframes_t n_frames, void *arg)
+{
+  unsigned chn;
+  jack_thread_info_t *info = (jack_thread_info_t *) arg;
+
+  /* Do nothing until we're ready to begin. */
+  if ((!info->can_process) || (!info->can_capture))
+    return 0;
+
+  jack_time_t t0 = jack_get_time();
+
+  for (chn = 0; chn < nports; chn++)
+    jack_in[chn] = jack_port_get_buffer (ports[chn], n_frames);
+
+  jack_nframes_t written = capture_write (jack_in, n_frames);
+  if (written < n_frames)
+    overruns += (n_frames - written) * nports;
+
+  /* Tell the disk thread there is work to do.  If it is already
+   * running, the lock will not be available.  We can't wait
+   * here in the process() thread, but we don't need to signal
+   * in that case, because the disk thread will read all the
+   * data queued before waiting again. */
+  if (pthread_mutex_trylock (&disk_thread_lock) == 0)
+  {
+    pthread_cond_signal (&data_ready);
+    pthread_mutex_unlock (&disk_thread_lock);
+  }
+
+  processUsec = jack_get_time() - t0;
+  processUsecMax = MAX(processUsecMax, processUsec);
+  processUsecSum += processUsec;
+  processCalls++;
+  processFrames = n_frames;
+
+  return 0;
+}
+// File source, -R. Capture is mmap'ed and fed to ringbuffer in blocks, same interleaved float frames as
+// capture_write() makes, so engine does not know the difference. Real time, or as fast as engine takes it (-L).
+// WAV and RF64: PCM 16, 24, 32 bit or float 32; raw: float 32, interleaved.
+#define FILEBLOCK 1024
+#define LE16(p) (*(uint16_t *)(p))
+#define LE32(p) (*(uint32_t *)(p))
+#define LE64(p) (*(uint64_t *)(p))
+uint8_t *fileMap = NULL;
+uint64_t fileSize;
+uint8_t *fileData;          // First frame
+uint64_t fileFrames;
+int fileDone = 0;           // Whole input went to ringbuffer
+int fileCh, fileBits, fileFloat;
+pthread_t file_thread_id;
+
+void fileOpen(char *arg)
+{
+  // Raw needs its format: name,rate,channels
+  char name[PATH_MAX];
+  strlcpy(name, arg, sizeof(name));
+  int rawRate = 0, rawCh = 0;
+  char *c2 = strrchr(name, ',');
+  if (c2)
+  {
+    *c2 = '\0';
+    char *c1 = strrchr(name, ',');
+    if (c1)
+    {
+      *c1 = '\0';
+      rawRate = atoi(c1 + 1);
+      rawCh = atoi(c2 + 1);
+    }
+    else
+      *c2 = ',';
+  }
+
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    ERR(S, "Can't open '%s': %s.", name, strerror(errno));
+  struct stat st;
+  fstat(fd, &st);
+  fileSize = st.st_size;
+  fileMap = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (fileMap == MAP_FAILED)
+    ERR(S, "Can't mmap '%s': %s.", name, strerror(errno));
+  madvise(fileMap, fileSize, MADV_SEQUENTIAL);
+
+  uint64_t bytes = 0;
+  if ((fileSize >= 12) && ((! memcmp(fileMap, "RIFF", 4)) || (! memcmp(fileMap, "RF64", 4))) && (! memcmp(fileMap + 8, "WAVE", 4)))
+  {
+    uint64_t pos = 12, ds64 = 0;
+    int tag = 0;
+    while (pos + 8 <= fileSize)
+    {
+      uint8_t *c = fileMap + pos;
+      uint64_t size = LE32(c + 4);
+      int isData = ! memcmp(c, "data", 4);
+      // Data chunk may be cut (recording that was not closed), it is taken up to end of file below; others must fit.
+      if ((! isData) && (pos + 8 + size > fileSize))
+        ERR(S, "'%s': chunk '%.4s' goes past end of file.", name, c);
+      if (! memcmp(c, "ds64", 4))
       {
-        jack_ringbuffer_read (rb, buf + bufPointer, gap);
-        bufPointer = chunkSize * chunksToRead - gap;
-        jack_ringbuffer_read (rb, buf + 0, bufPointer);
+        if (size < 24)
+          ERR(S, "'%s': ds64 chunk is too short.", name);
+        ds64 = LE64(c + 16); // After RIFF size
       }
-      else if (gap == chunkSize * chunksToRead)
+      else if (! memcmp(c, "fmt ", 4))
       {
-        jack_ringbuffer_read (rb, buf + bufPointer, chunkSize * chunksToRead);
-        bufPointer = 0;
+        if (size < 16)
+          ERR(S, "'%s': fmt chunk is too short.", name);
+        tag = LE16(c + 8);
+        fileCh = LE16(c + 10);
+        sampleRate = LE32(c + 12);
+        fileBits = LE16(c + 22);
+        if ((tag == 0xfffe) && (size >= 40))
+          tag = LE16(c + 32); // WAVE_FORMAT_EXTENSIBLE: sub format
       }
-      else
+      else if (isData)
       {
-        jack_ringbuffer_read (rb, buf + bufPointer, chunkSize * chunksToRead);
-        bufPointer = bufPointer + chunkSize * chunksToRead;
+        fileData = c + 8;
+        bytes = ((size == 0xffffffff) && (ds64)) ? ds64 : size;
+        bytes = MIN(bytes, fileSize - pos - 8);
+        break;
       }
+      pos += 8 + size + (size & 1);
+    }
 
-      rollPhase = (rollPhase + chunksToRead) % roll;
+    if ((! fileData) || (! fileCh))
+      ERR(S, "No fmt or data in '%s'.", name);
+    fileFloat = (tag == 3);
+    if (! (((tag == 1) && ((fileBits == 16) || (fileBits == 24) || (fileBits == 32))) || ((tag == 3) && (fileBits == 32))))
+      ERR(S, "'%s': format %d, %d bit is not supported.", name, tag, fileBits);
+  }
+  else
+  {
+    if ((rawRate <= 0) || (rawCh <= 0))
+      ERR(S, "'%s' is not WAV; for raw float use -R %s,RATE,CHANNELS.", name, name);
+    sampleRate = rawRate;
+    fileCh = rawCh;
+    fileBits = 32;
+    fileFloat = 1;
+    fileData = fileMap;
+    bytes = fileSize;
+  }
 
-      bufReadoutPointer = bufPointer - fftSize * jackPorts * sample_size_4bytes;
-      if (bufReadoutPointer < 0)
-        bufReadoutPointer = bufReadoutPointer + bufSize;
+  fileFrames = bytes / (fileCh * fileBits / 8);
+  MSG(S, "File '%s': %d ch, %ld Hz, %d bit %s, %.1f s.", name, fileCh, sampleRate, fileBits, fileFloat ? "float" : "int",
+      fileFrames / (double)sampleRate);
 
-      planNum = fftSizeK - MINFFTK;
+  for (int i = 0; i < MIN(fileCh, MAXCH); i++)
+    snprintf(portName[i], sizeof(portName[i]), "%.50s:%d", basename(name), i + 1);
+}
 
-      if ((memAddScheduled) || ((phosphor > 0) && (phosphor < MAXPHOSPHOR)))
-      {
-        memCurr = (memCurr + 1) % MAXMEM;
+// Frames pos ... pos + n - 1 to float, only channels we use.
+void fileConvert(float *dst, uint64_t pos, uint64_t n)
+{
+  int bps = fileBits / 8;
+  uint8_t *src = fileData + pos * fileCh * bps;
+  for (uint64_t i = 0; i < n; i++, src += fileCh * bps)
+    for (int chn = 0; chn < nports; chn++)
+    {
+      uint8_t *p = src + chn * bps;
+      float s;
+      if (fileFloat)
+        s = *(float *)p;
+      else if (bps == 2)
+        s = *(int16_t *)p / 32768.0f;
+      else if (bps == 3)
+        s = (int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.0f;
+      else
+        s = *(int32_t *)p / 2147483648.0f;
+      *dst++ = s;
+    }
+}
 
-        if (memAddScheduled)
-          memQty = MIN(memQty + 1, memorySlots + 1);
+// Synthetic source, -G RATE[:SEC],SRC[,SRC...]: one SRC per channel, both I and Q of it with -i. It is produced by
+// file_thread() as file is, so it can go in real time or with -L as fast as engine takes it. All is computed from
+// options only, so each run gives same samples.
+//   sine:HZ           unity sine
+//   enob:HZ[:BITS]    sine of largest code, quantized to BITS (with sign), 2...24 (float mantissa), 16 by default
+//   noise[:DBFS]      white gaussian noise, RMS -20 dBFS by default
+//   multi:HZ[:HZ...]  up to MAXTONES sines, each 1 / tones
+//   chirp:HZ0:HZ1:SEC linear sweep HZ0 to HZ1 each SEC; with -i, I/Q so it can go to negative Hz
+#define MAXTONES 16
+enum {GEN_SINE, GEN_ENOB, GEN_NOISE, GEN_MULTI, GEN_CHIRP};
+typedef struct
+{
+  int kind, tones, bits;
+  double amp;
+  double hz[MAXTONES];
+  double ph[MAXTONES];  // Cycles, 0...1; exact at block start
+  double hz0, hz1, dhz; // Chirp, dhz per sample
+  uint64_t rng;
+} gen_t;
+gen_t gens[MAXCH];
+
+void genOpen(char *arg)
+{
+  char spec[PATH_MAX], *save, *save2;
+  strlcpy(spec, arg, sizeof(spec));
+
+  char *tok = strtok_r(spec, ",", &save);
+  sampleRate = tok ? atol(tok) : 0;
+  if (sampleRate <= 0)
+    ERR(S, "-G: no sample rate in '%s'.", arg);
+  char *sec = strchr(tok, ':');
+  fileFrames = sec ? (uint64_t)(atof(sec + 1) * sampleRate) : UINT64_MAX;
+
+  fileCh = 0;
+  while ((tok = strtok_r(NULL, ",", &save)))
+  {
+    if ((fileCh + 1) * (optIQ + 1) > MAXCH)
+      ERR(S, "-G: more than %d sources.", MAXCH / (optIQ + 1));
+    gen_t *g = &gens[fileCh];
+    snprintf(portName[fileCh], sizeof(portName[fileCh]), "%.50s", tok);
+    char *kind = strtok_r(tok, ":", &save2);
+    double p[MAXTONES];
+    int np = 0;
+    for (char *v; (np < MAXTONES) && (v = strtok_r(NULL, ":", &save2)); )
+      p[np++] = atof(v);
+
+    g->amp = 1.0;
+    g->tones = 1;
+    g->rng = 0x9e3779b97f4a7c15UL * (fileCh + 1);
+    if ((! strcmp(kind, "sine")) && (np == 1))
+    {
+      g->kind = GEN_SINE;
+      g->hz[0] = p[0];
+    }
+    else if ((! strcmp(kind, "enob")) && (np >= 1))
+    {
+      g->kind = GEN_ENOB;
+      g->hz[0] = p[0];
+      g->bits = (np > 1) ? FIT((int)p[1], 2, 24) : 16;
+      g->amp = 1.0 - 1.0 / (1UL << (g->bits - 1)); // (2^(bits-1) - 1) * q: largest positive code
+    }
+    else if (! strcmp(kind, "noise"))
+    {
+      g->kind = GEN_NOISE;
+      g->amp = pow(10.0, ((np) ? p[0] : -20.0) / 20.0);
+    }
+    else if ((! strcmp(kind, "multi")) && (np >= 1))
+    {
+      g->kind = GEN_MULTI;
+      g->tones = np;
+      g->amp = 1.0 / np;
+      for (int t = 0; t < np; t++)
+        g->hz[t] = p[t];
+    }
+    else if ((! strcmp(kind, "chirp")) && (np == 3) && (p[2] > 0))
+    {
+      g->kind = GEN_CHIRP;
+      g->hz[0] = g->hz0 = p[0];
+      g->hz1 = p[1];
+      g->dhz = (p[1] - p[0]) / (p[2] * sampleRate);
+    }
+    else
+      ERR(S, "-G: bad source '%s', see -help.", portName[fileCh]);
+    fileCh++;
+  }
+
+  if (! fileCh)
+    ERR(S, "-G: no sources in '%s'.", arg);
+
+  // Each source is channel, its ports are I and Q.
+  if (optIQ)
+  {
+    for (int i = fileCh - 1; i >= 0; i--)
+    {
+      char name[64];
+      strlcpy(name, portName[i], sizeof(name));
+      snprintf(portName[i * 2 + 1], sizeof(portName[0]), "%.50s Q", name);
+      snprintf(portName[i * 2], sizeof(portName[0]), "%.50s I", name);
+    }
+    fileCh *= 2;
+  }
+  if (fileFrames == UINT64_MAX)
+  {
+    MSG(S, "Generator: %d ch, %ld Hz, endless.", fileCh, sampleRate);
+  }
+  else
+    MSG(S, "Generator: %d ch, %ld Hz, %.1f s.", fileCh, sampleRate, fileFrames / (double)sampleRate);
+}
+
+// xorshift64*, 53 bit to 0...1.
+static inline double genRand(gen_t *g)
+{
+  g->rng ^= g->rng >> 12;
+  g->rng ^= g->rng << 25;
+  g->rng ^= g->rng >> 27;
+  return ((g->rng * 0x2545f4914f6cdd1dUL) >> 11) * (1.0 / 9007199254740992.0);
+}
 
-        memAddScheduled = 0;
-      }
+// n frames, nports floats each. Tones are complex rotators, started from exact phase each block, so error does not
+// grow; chirp rotates its step too.
+void genFill(float *dst, uint64_t n)
+{
+  int stride = optIQ + 1;
+  for (int chn = 0; chn < nports; chn += stride)
+  {
+    gen_t *g = &gens[chn / stride];
+    float *o = dst + chn;
 
-      for (int ch = 0; ch < channels; ch++)
+    if (g->kind == GEN_NOISE)
+    {
+      // Box-Muller: two gaussian per two uniform, for I and Q.
+      for (uint64_t i = 0; i < n; i++, o += nports)
       {
-        fftExecuteAndProcessOneChannel(ch);
-        readSpaceAndDrawProgressbar();
-        if (! stopped)
-          processMessages();
-        if (discardCurrentFft)
-          break;
+        double r = g->amp * sqrt(-2.0 * log(1.0 - genRand(g))), a = 2.0 * M_PI * genRand(g);
+        o[0] = r * cos(a);
+        if (optIQ)
+          o[1] = r * sin(a);
       }
+      continue;
+    }
 
-      if (((! stopped) || (rePlot)) && (! discardCurrentFft))
-      {
-        newPlot();
+    for (uint64_t i = 0; i < n; i++)
+      o[i * nports] = o[i * nports + optIQ] = 0.0f;
 
-        if (optOpengl)
+    // ENOB is one tone, quantized in double before it goes to float; it is exact there up to 24 bits.
+    double q = (g->kind == GEN_ENOB) ? 1.0 / (1UL << (g->bits - 1)) : 0.0;
+
+    for (int t = 0; t < g->tones; t++)
+    {
+      double c = cos(2.0 * M_PI * g->ph[t]), s = sin(2.0 * M_PI * g->ph[t]);
+      double wc = cos(2.0 * M_PI * g->hz[t] / sampleRate), ws = sin(2.0 * M_PI * g->hz[t] / sampleRate);
+      double rc = cos(2.0 * M_PI * g->dhz / sampleRate), rs = sin(2.0 * M_PI * g->dhz / sampleRate);
+      for (uint64_t i = 0; i < n; i++)
+      {
+        double vi = g->amp * c, vq = g->amp * s;
+        if (q)
         {
-          XImage *xim;
-          xim = XGetImage(dpy, pm, 0, 0, winW, winH, AllPlanes, ZPixmap);
-          if (! xim)
-              ERR(X, "XGetImage() failed.");
-
-          // Phase 1. Plot screen base (grid, legend...)
-          glLoadIdentity();
-          glOrtho(0, winW, 0, winH, -1.0, 1.0);
-          glPixelZoom(glScale, - glScale); // Turn it upside down.
-          glWindowPos2i(0, winH);
-          glBlendFunc(GL_ONE, GL_ZERO); // Disable blending.
-          glDrawPixels(winW, winH, GL_BGRA, GL_UNSIGNED_BYTE, (void*)(&(xim->data[0])) );
-          XDestroyImage(xim);
-
-          // Phase 2. Plot spectrograms
-          // We have special 0.5 px shifts, and turn it upside down, to exact match openGL lines with X11.
-          glLoadIdentity();
-          glOrtho(0 - 0.5, winW / glScale - 0.5, winH / glScale - 0.5, 0 - 0.5, -1.0, 1.0);
-          // glEnable(GL_COLOR_LOGIC_OP);
-          // glLogicOp(GL_OR); // It also works like GXor.
-          glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_COLOR); // Like GXor or better.
+          vi = rint(vi / q) * q;
+          vq = rint(vq / q) * q;
         }
-
-        for (int ch = 0; ch < channels; ch++)
-          plotOneChannel(ch);
-
-        // Phase 3. Plot markers on top of all.
-        if (optOpengl)
+        o[i * nports] += vi;
+        if (optIQ)
+          o[i * nports + 1] += vq;
+        double c1 = c * wc - s * ws;
+        s = c * ws + s * wc;
+        c = c1;
+        if (g->dhz != 0.0)
         {
-          glLoadIdentity();
-          glOrtho(0, winW, 0, winH, -1.0, 1.0);
+          double w1 = wc * rc - ws * rs;
+          ws = wc * rs + ws * rc;
+          wc = w1;
         }
-
-        plotOneChannelMkr(mkrCh[0], 0);
-        plotOneChannelMkr(mkrCh[1], 1);
-
-        if (! optOpengl)
-          XFlushArea(PLOTAREA);
-        else
-          glXSwapBuffers(dpy, win);
-
-        if ((phosphor > 0) && (phosphor < MAXPHOSPHOR))
-          memQty = MIN(memQty + 1, phosphor + 1);
-
-        memPrev = memCurr;
-        vbwContinue = 1;
-
-        rePlot = 0;
       }
-
-      lowCpu = 1;
- start:
-      readSpaceAndDrawProgressbar();
-      processMessages();
-
-      if (programExit)
-        goto done;
+      double cycles = (g->hz[t] * n + g->dhz * n * (n - 1) / 2.0) / sampleRate;
+      g->ph[t] = fmod(g->ph[t] + cycles - floor(cycles), 1.0);
+      if (g->ph[t] < 0)
+        g->ph[t] += 1.0;
     }
 
-    /* wait until process() signals more data */
-    pthread_cond_wait (&data_ready, &disk_thread_lock);
-  }
-
- done:
-  pthread_mutex_unlock (&disk_thread_lock);
-  free (buf);
-
-  if (optOpengl)
-  {
-    glXDestroyContext(dpy, glcontext);
-    glXMakeCurrent(dpy, None, NULL);
+    if (g->kind == GEN_CHIRP)
+    {
+      g->hz[0] += g->dhz * n;
+      if ((g->hz[0] - g->hz1) * (g->hz1 - g->hz0) >= 0)
+        g->hz[0] = g->hz0;
+    }
   }
-
-  return 0;
 }
 
-
-static int
-jack_process (jack_nframes_t n_frames, void *arg)
+static void *
+file_thread (void *arg)
 {
-  unsigned chn;
-  size_t i;
   jack_thread_info_t *info = (jack_thread_info_t *) arg;
+  uint64_t frameBytes = nports * sample_size_4bytes;
+  float *block = malloc(FILEBLOCK * frameBytes);
+  uint64_t pos = 0, t0 = 0, paced = 0;
 
-  /* Do nothing until we're ready to begin. */
-  if ((!info->can_process) || (!info->can_capture))
-    return 0;
+  while ((! programExit) && (pos < fileFrames))
+  {
+    if ((! info->can_process) || (! info->can_capture))
+    {
+      usleep(1000);
+      continue;
+    }
+    if (! t0)
+      t0 = nsNow();
 
-  for (chn = 0; chn < nports; chn++)
-    jack_in[chn] = jack_port_get_buffer (ports[chn], n_frames);
+    uint64_t n = MIN(FILEBLOCK, fileFrames - pos);
+    if (jack_ringbuffer_write_space(rb) < n * frameBytes)
+    {
+      // Fast: wait for engine. Real time: lost, as with JACK.
+      if (optFast)
+      {
+        usleep(200);
+        continue;
+      }
+      overruns += n * nports;
+    }
+    else
+    {
+      if (optGen)
+        genFill(block, n);
+      else
+        fileConvert(block, pos, n);
+      jack_ringbuffer_write(rb, (char *)block, n * frameBytes);
+    }
+    pos += n;
 
-  for (i = 0; i < n_frames; i++)
-    for (chn = 0; chn < nports; chn++)
-      if (jack_ringbuffer_write (rb, (void *) (jack_in[chn]+i), sample_size_4bytes) < sample_size_4bytes)
-        overruns++;
+    if (pthread_mutex_trylock (&disk_thread_lock) == 0)
+    {
+      pthread_cond_signal (&data_ready);
+      pthread_mutex_unlock (&disk_thread_lock);
+    }
 
-  /* Tell the disk thread there is work to do.  If it is already
-   * running, the lock will not be available.  We can't wait
-   * here in the process() thread, but we don't need to signal
-   * in that case, because the disk thread will read all the
-   * data queued before waiting again. */
-  if (pthread_mutex_trylock (&disk_thread_lock) == 0)
+    if (! optFast)
+    {
+      paced = t0 + (uint64_t)(pos * 1e9 / sampleRate);
+      struct timespec ts = {paced / 1000000000UL, paced % 1000000000UL};
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+  }
+
+  fileDone = (pos >= fileFrames);
+  if (fileDone)
+    MSG(S, "End of input: %.1f s of signal in %.1f s.", fileFrames / (double)sampleRate, (nsNow() - t0) / 1e9);
+
+  // Picture stays; engine still needs wake up to see exit. Headless is done when engine took all of file.
+  while (! programExit)
   {
+    if ((optHeadless) && (jack_ringbuffer_read_space(rb) < chunkSize))
+      programExit = 1;
+    usleep(20000);
     pthread_cond_signal (&data_ready);
-    pthread_mutex_unlock (&disk_thread_lock);
   }
+  pthread_cond_signal (&data_ready);
 
+  free(block);
   return 0;
 }
 
+
 static void signal_handler(int sig)
 {
   MSG(S, "Signal: Exit.");
@@ -2053,18 +5072,37 @@ run_disk_thread (jack_thread_info_t *info)
 {
   info->can_capture = 1;
   pthread_join (info->thread_id, NULL);
+  if (! optHeadless)
+    pthread_join (render_thread_id, NULL);
+  if ((optRead) || (optGen))
+    pthread_join (file_thread_id, NULL);
   if (overruns > 0)
   {
     WRN(J, "We have %ld overruns. Try rb_size > %d ?", overruns, info->rb_size);
     info->status = EPIPE;
   }
+  if (optHeadless)
+  {
+    MSG(S, "Headless: %ld spectra x %ld channel(s), %.1f s of signal.", outSpectra, channels, audioNs / 1e9);
+    // Whole input went through: one spectrum per chunk, rest of last chunk is not enough for one.
+    uint64_t expected = fileFrames * roll / (fftSize * zoomD);
+    if ((fileDone) && (! overruns) && (outSpectra != expected))
+      WRN(S, "Headless: %ld spectra expected, %ld written.", expected, outSpectra);
+  }
+  if (processCalls > 0)
+    MSG(J, "Process callback: avg %.1f us, max %ld us, of %.1f us per %d frames.", processUsecSum / (double)processCalls, processUsecMax, processFrames * 1e6 / sampleRate, processFrames);
+
+  for (int t = 0; t < TIMERS; t++)
+    if (timers[t].frames)
+      MSG(S, "%-6s %5.1f%% of real time, avg %.3f ms, p99 < %ld us per frame.", timerStr[t], timerLoad(t), timers[t].sumNs / 1e6 / timers[t].frames, timerPercentile(t, 0.99));
+  MSG(F, "Window tables: %.1f MB (%s).", windowBytes / 1e6, optWinFloat ? "float" : "double");
 }
 
 
 // #define CALC_GAIN 3 // Set to window number of interest.
 
 // Precision tested, no any benefit from 'long double' yet.
-void windowfunc_calc(int planNum, uint64_t size)
+void windowfunc_calc(int p, int w, uint64_t size)
 {
   // NOTE All windows should have unity gain. Use CALC_GAIN if in doubt.
   // double windowSine(double i, double s) {
@@ -2100,13 +5138,23 @@ void windowfunc_calc(int planNum, uint64_t size)
   for (uint64_t j = 0; j < size / 2; j++)
   {
     double ang = M_PI * (j - half_correction) / (size - 1.0);
+    double v;
+
+    switch (w)
+    {
+      case 0:  v = windowBlackman(ang); break; // 1.0 if NoWindow
+      case 1:  v = windowHanning(ang);  break;
+      case 2:  v = windowFlatTop(ang);  break;
+      default: v = windowHFT144D(ang);  break;
+    }
 
-    windowfunc[planNum][0][j] = windowBlackman(ang); // 1.0 if NoWindow
-    windowfunc[planNum][1][j] = windowHanning(ang);
-    windowfunc[planNum][2][j] = windowFlatTop(ang);
-    windowfunc[planNum][3][j] = windowHFT144D(ang);
+    if (optWinFloat)
+      windowfuncF[p][w][j] = v;
+    else
+      windowfunc[p][w][j] = v;
 #ifdef CALC_GAIN
-    windowgain = windowgain + windowfunc[planNum][CALC_GAIN][j];
+    if (w == CALC_GAIN)
+      windowgain = windowgain + v;
 #endif
   }
 #ifdef CALC_GAIN
@@ -2172,7 +5220,16 @@ void initOpengl(void)
   int attribs[] = { // change it for your needs
       GLX_CONTEXT_MAJOR_VERSION_ARB, 2,
       GLX_CONTEXT_MINOR_VERSION_ARB, 1,
-      0};
+      0, 0, 0};
+
+  // Shader renderer: 3.3, but compatibility profile, as screen base and markers are still fixed function.
+  if (optGlCore)
+  {
+    attribs[1] = 3;
+    attribs[3] = 3;
+    attribs[4] = GLX_CONTEXT_PROFILE_MASK_ARB;
+    attribs[5] = GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+  }
 
   glcontext = glXCreateContextAttribsARB(dpy, fbconfig, 0, 1, attribs);
 
@@ -2184,6 +5241,135 @@ void initOpengl(void)
 }
 
 
+// fftw3 wisdom cache. Planner level > 0 measures each plan (slow), so we keep results between runs,
+// and then only sizes not yet in wisdom are measured. Wisdom depends on fftw3 threads number, too.
+char wisdomPath[PATH_MAX];
+int wisdomLoaded = 0;
+
+// Our cache directory, made if needed. Returns 0 if there is no place for it.
+int cacheDir(char *path, size_t size)
+{
+  char *cache = getenv("XDG_CACHE_HOME");
+  char *home = getenv("HOME");
+
+  if ((cache) && (*cache))
+    snprintf(path, size, "%s/jasmine-sa", cache);
+  else if (home)
+    snprintf(path, size, "%s/.cache/jasmine-sa", home);
+  else
+    return 0;
+
+  mkdir(path, 0755); // Fails if exists, that's fine.
+  return 1;
+}
+
+void wisdomLoad(void)
+{
+  if (! cacheDir(wisdomPath, sizeof(wisdomPath)))
+    return;
+
+  // Double and float have separate wisdom.
+  strlcat(wisdomPath, SINGLE ? "/fftw3f.wisdom" : "/fftw3.wisdom", sizeof(wisdomPath));
+
+  wisdomLoaded = SINGLE ? fftwf_import_wisdom_from_filename(wisdomPath) : fftw_import_wisdom_from_filename(wisdomPath);
+  if (wisdomLoaded)
+  {
+    MSG(F, "Wisdom loaded from '%s'.", wisdomPath);
+  }
+  else
+    DBG(F, "No wisdom at '%s' yet.", wisdomPath);
+}
+
+void wisdomSave(void)
+{
+  if (! *wisdomPath)
+    return;
+
+  if (! (SINGLE ? fftwf_export_wisdom_to_filename(wisdomPath) : fftw_export_wisdom_to_filename(wisdomPath)))
+    WRN(F, "Can't save wisdom to '%s'.", wisdomPath);
+}
+
+
+// Auto calibration, -a. Per sample cost of Stages 1, 2 and 3 for each FFT size, on this machine, backend and channels,
+// measured by bench code at startup once, then profile is cached next to wisdom. newFft() takes RBW limits and roll
+// from it, so engine stays within given CPU share.
+void autocal(void)
+{
+  char path[PATH_MAX];
+  int cached = cacheDir(path, sizeof(path));
+  if (cached)
+  {
+    char name[64];
+    snprintf(name, sizeof(name), "/autocal-t%d-i%d-c%ld-j%d-w%d-x%d-b%d", optType, optIQ, channels, jobs, optWinFloat, xSize,
+        optBatch);
+    strlcat(path, name, sizeof(path));
+
+    FILE *f = fopen(path, "r");
+    int k;
+    double cps;
+    while ((f) && (fscanf(f, "%d %lf", &k, &cps) == 2))
+      if ((k >= MINFFTK) && (k <= maxFFTK))
+        calCps[k - MINFFTK] = cps;
+    if (f)
+      fclose(f);
+  }
+
+  int measured = 0;
+  for (int k = MINFFTK; k <= maxFFTK; k++)
+    if (! calCps[k - MINFFTK])
+    {
+      if (! measured++)
+        benchInit(channels);
+      for (int ch = 0; ch < MAXCH; ch++)
+        fftWindow[ch] = DEFWIN;
+      double ns[3];
+      benchSetup(k);
+      benchTime(channels, ns);
+      calCps[k - MINFFTK] = (ns[0] + ns[1] + ns[2]) / (1UL << k);
+    }
+
+  if (measured)
+  {
+    free(buf);
+    buf = NULL;
+    bufSizeInSamples = 0;
+    FILE *f = cached ? fopen(path, "w") : NULL;
+    for (int k = MINFFTK; (f) && (k <= maxFFTK); k++)
+      fprintf(f, "%d %g\n", k, calCps[k - MINFFTK]);
+    if (f)
+      fclose(f);
+    else if (cached)
+      WRN(S, "Can't save calibration to '%s'.", path);
+  }
+
+  // Workers share channels; cache is of one worker, so -W does not change it. Batched FFT is one call, so it is
+  // taken as one worker.
+  calPar = optBatch ? 1 : MIN(workers, channels);
+
+  // Smallest FFT that is affordable at roll 1 gives max FFT rate; largest one caps RBW.
+  double budget = calShare * 1e7 * calPar / sampleRate; // ns per sample
+  int kMin = 0;
+  calKmax = 0;
+  for (int k = MINFFTK; k <= maxFFTK; k++)
+    if (calCps[k - MINFFTK] <= budget)
+    {
+      if (! kMin)
+        kMin = k;
+      calKmax = k;
+    }
+
+  if (! kMin)
+  {
+    WRN(S, "Calibration: no FFT size fits into %d%% of CPU.", calShare);
+    kMin = calKmax = maxFFTK;
+  }
+  maxFps = MAX(sampleRate >> kMin, 1);
+
+  MSG(S, "Calibration (%s): %d%% of CPU gives FFT %ld...%ld, max %d FPS.", measured ? "measured" : "cached", calShare,
+      1UL << kMin, 1UL << calKmax, maxFps);
+}
+
+
 #define FREE(how,what)  if (what) how(what)
 #define XFREE(how,what) if (what) how(dpy, what)
 static void cleanup()
@@ -2201,53 +5387,110 @@ static void cleanup()
       for (int t = 0; t < 2; t++)
         XFREE(XFreeGC, lineColor[ch * GRADIENTS + grad][t]);
 
+  swDestroy();
+  FREE(free, densRing);
+  FREE(free, wfAcc);
+  FREE(XDestroyImage, wfImg);
+  XFREE(XFreePixmap, wfPm);
+  FREE(free, densHits);
+  if (densImg)
+    XFreeGC(dpy, densGc);
+  FREE(XDestroyImage, densImg);
   XFREE(XFreePixmap, pm);
-  if (optOpengl)
-    XFREE(XFreePixmap, pmMkr);
+  XFREE(XFreePixmap, pmBase);
+  XFREE(XFreePixmap, atlasGlyph);
+  XFREE(XFreePixmap, atlasOutline);
+  for (int k = 0; k < 2; k++)
+  {
+    XFREE(XFreePixmap, labelGlyph[k]);
+    XFREE(XFreePixmap, labelOutline[k]);
+  }
+  XFREE(XFreeGC, atlasGc);
 
-  if (windowBits & 8)
+  if ((windowBits & 8) && (dpy))
     XScreenSaverSuspend (dpy, 0);
 
   FREE(XCloseDisplay, dpy); // XCloseDisplay(dpy)
   DBG(S, "Cleanup phase 1 reached.");
 
-  for (int i = 0; i < channels; i++)
+  // Planner may still use buffers.
+  planStop();
+
+  // Batched buffers are one allocation, at channel 0.
+  for (int i = 0; i < (optBatch ? 1 : channels); i++)
   {
-    if (optIQ)
-      fftw_free (fftin[i]);
-    else
-      fftw_free (fftinR[i]);
-    fftw_free (fftout[i]);
+    FREE(fftw_free, fftin[i]);
+    FREE(fftw_free, fftout[i]);
+  }
+  for (int i = 0; i < MAXCH; i++)
+    FREE(free, zoom[i].ring);
+  FREE(free, data);
+  for (int i = 0; i < 3; i++)
+  {
+    FREE(free, frames[i].data);
+    FREE(free, frames[i].wf);
   }
   DBG(S, "Cleanup phase 2 reached.");
 
   for (int p = 0; p < plans; p++)
   {
+    if (! planReady[p])
+      continue;
+
     for (int i = 0; i < MAXWIN; i++)
-      fftw_free (windowfunc[p][i]);
+    {
+      FREE(fftw_free, windowfunc[p][i]);
+      FREE(fftw_free, windowfuncF[p][i]);
+    }
 
-    if (optType)
-      if (optIQ)
-        kfr_dft_delete_plan_f64(plan_kfr[p]);
-      else
-        kfr_dft_real_delete_plan_f64(plan_kfr_real[p]);
+    if (KFR && SINGLE)
+    {
+      FREE(kfr_dft_delete_plan_f32, plan_kfr_f32[p]);
+      FREE(kfr_dft_real_delete_plan_f32, plan_kfr_real_f32[p]);
+    }
+    else if KFR
+    {
+      FREE(kfr_dft_delete_plan_f64, plan_kfr[p]);
+      FREE(kfr_dft_real_delete_plan_f64, plan_kfr_real[p]);
+    }
+    else if SINGLE
+    {
+      fftwf_destroy_plan (optBatch ? plan_batchf[p] : plan_fftwf[p]);
+      FREE(fftwf_destroy_plan, plan_fftwzf[p]);
+    }
     else
-      for (int i = 0; i < channels; i++)
-        fftw_destroy_plan (plan_fftw[p][i]);
+    {
+      fftw_destroy_plan (optBatch ? plan_batch[p] : plan_fftw[p]);
+      FREE(fftw_destroy_plan, plan_fftwz[p]);
+    }
   }
   DBG(S, "Cleanup phase 3 reached.");
 
-  if (optType)
+  if KFR
   {
-    if (tmp)
-      kfr_deallocate(tmp);
+    for (int w = 0; w < workers; w++)
+      if (tmp[w])
+        kfr_deallocate(tmp[w]);
   }
   else
   {
-    if (jobs > 1)
-      fftw_cleanup_threads();
+    if (planner)
+      wisdomSave();
+
+    if (SINGLE)
+    {
+      if (jobs > 1)
+        fftwf_cleanup_threads();
+
+      fftwf_cleanup();
+    }
+    else
+    {
+      if (jobs > 1)
+        fftw_cleanup_threads();
 
-    fftw_cleanup();
+      fftw_cleanup();
+    }
   }
   DBG(S, "Cleanup phase 4 reached.");
 
@@ -2256,8 +5499,13 @@ static void cleanup()
   DBG(S, "Cleanup phase 5 reached.");
 
   FREE(jack_ringbuffer_free, rb);
+  outClose();
+  if (fileMap)
+    munmap(fileMap, fileSize);
   DBG(S, "Cleanup phase 6 reached.");
 
+  traceClose();
+
   free(ports);
   free(jack_in);
   DBG(S, "Cleanup done, should exit now.");
@@ -2307,11 +5555,18 @@ int main(int argc, char *argv[])
         yDbMin    = FIT(MIN(tmp0, tmp1), -320, yDbMax - yGrids);
         break;
 
-      case 't':     optType = FIT(ul, 0, 1);    break;
+      case 't':     optType = FIT(ul, 0, 3);    benchFix |= 1; break;
       case 'k':     maxFFTK = FIT(ul, MINFFTK, MAXFFTK); break;
       case 'r':     maxRoll = FIT(ul, 1, 256);  break;
-      case 'j':        jobs = FIT(ul, 1, 4);    break;
+      case 'j':        jobs = FIT(ul, 1, 4);    benchFix |= 2; break;
+      case 'W':     workers = FIT(ul, 1, MAXCH); break;
+      case 'B':    optBatch = 1; benchFix |= 8; break;
+      case 'I': optWinFloat = 1; break;
+      case 'Z':     optZoom = 1; break;
+      case 'P':     planner = FIT(ul, 0, 2);    break;
       case 'p':  defPhospor = FIT(ul, 0, 16);   break;
+      case 'E':  density = 1; densityMs = FIT(ul, 10, 60000); break;
+      case 'U':  wfRows = FIT(ul, 0, MAXYSIZE); break;
       case 'u': subGridSize = FIT(ul, 0, 10);   break;
       case 's': crtRayStyle = FIT(ul, 0, 7);    break;
       case 'v':     verbose = FIT(ul, 0, 4);    break;
@@ -2329,11 +5584,21 @@ int main(int argc, char *argv[])
       case 'S': openglScale = FIT(ul, 100, 400); break;
       case 'F':  openglFont = FIT(ul, 100, 400); break;
       case 'O':   optOpengl = 1; break;
+      case 'C':   optOpengl = optGlCore = 1; break;
+      case 'X':   optShm = 1; break;
+      case 'R':   optRead = optarg; break;
+      case 'G':   optGen = optarg; break;
+      case 'L':   optFast = 1; break;
+      case 'H':   optHeadless = optarg; break;
+      case 'Q':   optCsv = 1; break;
+      case 'Y':   optBench = optarg; break;
+      case 'a':    calShare = FIT(ul, 10, 100); break;
       case 'f':  optRayFade = 1; break;
       case 'e': optShowEnob = 1; break;
-      case 'i':       optIQ = 1; break;
+      case 'i':       optIQ = 1; benchFix |= 4; break;
       case 'z': optShowZero = 1; break;
       case 'w': optRevWheel = 1; break;
+      case 'T': traceOpen(optarg); break;
       default:
         usage(argv[0]);
         return -1;
@@ -2343,6 +5608,17 @@ int main(int argc, char *argv[])
   if ((optIQ) && (! xUpdated))
     xHzMin = -xHzMax;
 
+  // Messages go to stdout too.
+  if ((optHeadless) && (! strcmp(optHeadless, "-")))
+    verbose = MIN(verbose, 1);
+  if (optBench)
+    verbose = MIN(verbose, 1);
+  if ((optHeadless) && ((optOpengl) || (optShm) || (density) || (wfRows)))
+  {
+    WRN(S, "Headless: display options are ignored.");
+    optOpengl = optGlCore = optShm = density = wfRows = 0;
+  }
+
 // Geometry of plot
   if ((yDbMax - yDbMin) % yGrids != 0)
     ERR(P, "dB span %d to grids %d ratio must be integer.", yDbMax - yDbMin, yGrids);
@@ -2362,6 +5638,33 @@ int main(int argc, char *argv[])
   const char *client_name = "jasmine-sa";
   const char *server_name = NULL;
   jack_status_t status;
+  uint64_t periodsize = FILEBLOCK;
+
+  // Parent does not return; child has its channels and ports set.
+  if (optBench)
+  {
+    benchMain();
+    sampleRate = 48000;
+    goto jackDone;
+  }
+
+  if ((optRead) || (optGen))
+  {
+    // File or generator channels are ports; those over MAXCH are not used.
+    if (optGen)
+      genOpen(optGen);
+    else
+      fileOpen(optRead);
+    channels = MIN(fileCh, MAXCH) / (optIQ + 1);
+    jackPorts = channels * (optIQ + 1);
+    if (channels <= 0)
+      ERR(S, "File has %d channel(s), -i needs pairs.", fileCh);
+    if (fileCh > jackPorts)
+      WRN(S, "Only %ld of %d file channels are used.", jackPorts, fileCh);
+    if (argc > optind)
+      WRN(S, "Ports are not used with -R or -G.");
+    goto jackDone;
+  }
 
   channels = (argc - optind) / (optIQ + 1);
   jackPorts = channels * (optIQ + 1);
@@ -2391,7 +5694,8 @@ int main(int argc, char *argv[])
   }
 
   sampleRate = jack_get_sample_rate(client);
-  uint64_t periodsize = jack_get_buffer_size(client);
+  periodsize = jack_get_buffer_size(client);
+ jackDone:
 // It is important to keep arrays as small as possible to minimize memory page switch latency effects.
   uint64_t rb_size = (1UL << maxFFTK) * jackPorts / sample_size_4bytes * 2;
 
@@ -2406,76 +5710,94 @@ int main(int argc, char *argv[])
   thread_info.can_process = 0;
 
 // Init FFT
-  if ((! optType) && (jobs > 1))
+  if ((! KFR) && (jobs > 1))
   {
-    if (! fftw_init_threads())
+    if (! (SINGLE ? fftwf_init_threads() : fftw_init_threads()))
       ERR(F, "Thread creation error.");
 
-    fftw_plan_with_nthreads(jobs);
+    if (SINGLE)
+      fftwf_plan_with_nthreads(jobs);
+    else
+      fftw_plan_with_nthreads(jobs);
     MSG(F, "Using %d fftw3 threads.", jobs);
   }
 
-  // Looks like, it works fine for both fftw3 and kfrlib.
-  for (int i = 0; i < channels; i++)
+  // Measured planning overwrites arrays, see planBuild().
+  planFlags = (unsigned[]){FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT}[planner] | FFTW_DESTROY_INPUT;
+
+  if ((! KFR) && (planner))
   {
-    if (optIQ)
-    {
-      fftin[i]  = fftw_alloc_complex(1UL << maxFFTK);
-      fftout[i] = fftw_alloc_complex(1UL << maxFFTK);
-    }
-    else
-    {
-      // The input is n real numbers, while the output is n/2+1 complex numbers. [6]
-      fftinR[i]  = fftw_alloc_real(1UL << maxFFTK);
-      // fftw_complex is double.
-      fftout[i] = fftw_alloc_complex((1UL << maxFFTK) / 2 + 1);
-    }
+    wisdomLoad();
+    MSG(F, "Planning with %s, it can take a while for sizes not in wisdom.", planner == 1 ? "FFTW_MEASURE" : "FFTW_PATIENT");
+  }
+  else if (planner)
+  {
+    WRN(F, "Planner level is fftw3 only, ignored.");
+    planner = 0;
   }
 
-  plans = (maxFFTK - MINFFTK + 1);
-  uint64_t tmpSize = 0;
-
-  for (int p = 0; p < plans; p++)
+  if ((KFR) && (optBatch))
   {
-    fftSizeK = MINFFTK + p;
-    uint64_t size = 1UL << fftSizeK; // should be < INT_MAX
+    WRN(F, "Batched FFT is fftw3 only, ignored.");
+    optBatch = 0;
+  }
 
-    DBG(F, "Plan calculate for %ld points, 4 windows.", size);
+  // Float FFT is float from input to output, window too: float table is as precise as float multiply anyway.
+  if (SINGLE)
+    optWinFloat = 1;
 
-    if (optType)
-      if (optIQ)
-      {
-        plan_kfr[p] = kfr_dft_create_plan_f64(size);
-        tmpSize = MAX(tmpSize, kfr_dft_get_temp_size_f64(plan_kfr[p]));
-      }
-      else
-      {
-        plan_kfr_real[p] = kfr_dft_real_create_plan_f64(size, 1); // KFR_PACK_CCS
-        tmpSize = MAX(tmpSize, kfr_dft_real_get_temp_size_f64(plan_kfr_real[p]));
-      }
-    else
-      for (int c = 0; c < channels; c++)
-        if (optIQ)
-          plan_fftw[p][c] = fftw_plan_dft_1d(size, fftin[c], fftout[c], -1, FFTW_ESTIMATE | FFTW_DESTROY_INPUT); // | FFTW_PATIENT
-        else
-          plan_fftw[p][c] = fftw_plan_dft_r2c_1d(size, fftinR[c], fftout[c], FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+  // Batched: all channels are one contiguous allocation, channel is at batchInDist (input) or batchOutDist (output) offset.
+  // Output distance is kept multiple of 4, so each channel stays 32 byte aligned for SIMD codelets, both double and float.
+  uint64_t maxN = 1UL << maxFFTK;
+  batchInDist = maxN;
+  batchOutDist = optIQ ? maxN : maxN / 2 + 4;
+  realSize = SINGLE ? sizeof(float) : sizeof(double);
 
-    // Looks like, it works fine for both fftw3 and kfrlib.
-    for (int w = 0; w < MAXWIN; w++)
-      windowfunc[p][w] = fftw_alloc_real(size * sizeof(double) / 2);
+  // The input is n real numbers, while the output is n/2+1 complex numbers. [6]
+  uint64_t inBytes = (optBatch ? batchInDist : maxN) * (optIQ ? 2 : 1) * realSize;
+  uint64_t outBytes = (optBatch ? batchOutDist : (optIQ ? maxN : maxN / 2 + 1)) * 2 * realSize;
+  uint8_t *inBase = NULL, *outBase = NULL;
 
-    windowfunc_calc(p, size);
+  if (optBatch)
+  {
+    inBase = fftw_malloc(inBytes * channels);
+    outBase = fftw_malloc(outBytes * channels);
   }
 
-  if (tmpSize)
-    // W/o this check, valgrind says invalid size value: 0 posix_memalign
-    tmp = (uint8_t*)kfr_allocate(tmpSize);
-  else
-    tmp = NULL; // Is this correct? FIXME
-  DBG(F, "Kfr tmp allocated %ld bytes.", tmpSize);
+  // Looks like, it works fine for both fftw3 and kfrlib.
+  for (int i = 0; i < channels; i++)
+  {
+    void *in = optBatch ? inBase + i * inBytes : fftw_malloc(inBytes);
+    void *out = optBatch ? outBase + i * outBytes : fftw_malloc(outBytes);
+
+    // Same buffer as any of types; only one of them is used, see optIQ and SINGLE.
+    fftin[i] = in;
+    fftinR[i] = in;
+    fftinF[i] = in;
+    fftinRF[i] = in;
+    fftout[i] = out;
+    fftoutF[i] = out;
+  }
+  MSG(F, "FFT buffers: %.1f MB.", (inBytes + outBytes) * channels / 1e6);
+
+  // Plans and windows are built on demand, see planSelect().
+  plans = (maxFFTK - MINFFTK + 1);
+  pthread_create (&plan_thread_id, NULL, plan_thread, NULL);
+
+  if (optZoom)
+    zoomCoefCalc();
+
+  if (optBench)
+    benchRun();
 
 
 // Init GUI.
+  if (optHeadless)
+  {
+    outOpen();
+    goto guiDone;
+  }
+
   const char *title = "Jasmine-SA";
 
   dpy = XOpenDisplay(0);
@@ -2500,6 +5822,8 @@ int main(int argc, char *argv[])
   if (! (windowBits & (16 + 32)))
     winW = winW + LEGENDWIDTH - 2;
   winH = DY + ySize + DX + !!(windowBits & 16); // 32
+  if (wfRows)
+    winH = WFY + wfRows + 8;
 
   if (optOpengl)
   {
@@ -2558,8 +5882,16 @@ int main(int argc, char *argv[])
   setFontAndColors();
 
   pm = XCreatePixmap(dpy, win, winW, winH, wa.depth);
-  if (optOpengl)
-    pmMkr = XCreatePixmap(dpy, win, mkrW, mkrH, wa.depth);
+  pmBase = XCreatePixmap(dpy, win, winW, winH, wa.depth);
+  atlasBuild();
+
+  if ((optShm) && (optOpengl))
+  {
+    WRN(X, "Software renderer is for X11 only, -X ignored.");
+    optShm = 0;
+  }
+  if (optShm)
+    swInit();
 
   wm_delete_window = XInternAtom(dpy, "WM_DELETE_WINDOW", 0);
   XSetWMProtocols(dpy, win, &wm_delete_window, 1);
@@ -2573,20 +5905,58 @@ int main(int argc, char *argv[])
     XScreenSaverSuspend (dpy, 1);
 
   DBG(X, "Window %dx%dx%dbpp created.", winW, winH, wa.depth);
+ guiDone:
+
+
+// Init internals
+  // Traces: engine one and three frames. Bins never exceed xSize / MINSTEP, see columnsCalc().
+  dataBins = MIN((int)(xSize / MINSTEP) + 1, MAXDATA);
+  uint64_t traceBytes = MAXMEM * channels * dataBins * sizeof(int16_t);
+  data = calloc(traceBytes, 1);
+  for (int i = 0; i < 3; i++)
+  {
+    frames[i].data = calloc(traceBytes, 1);
+    frames[i].amptZero = frames[i].amptMax = frames[i].amptOverload = -1;
+  }
+  DBG(S, "Traces use 4 x %.1f MB.", traceBytes / 1e6);
+  if (density)
+    densityAlloc();
+  if (wfRows)
+  {
+    wfAcc = calloc(channels * dataBins, sizeof(int16_t));
+    for (int i = 0; i < 3; i++)
+      frames[i].wf = calloc(channels * dataBins, sizeof(int16_t));
+  }
+
+  (spanHz < 0.1 * kHz) ? (units = Hz) : (units = kHz);
+
+  maxHz = sampleRate / 2;
+  minHz = optIQ ? -(int)maxHz : 0;
+  minSpanHz = xGrids;
+  maxSpanHz = sampleRate;
+
+  // Before engine threads: it takes engine state, and its own input in buf; reset then makes state anew.
+  if (calShare)
+    autocal();
 
 
 // JACK Part 2: Now we know that GUI setup, which takes some time, is done.
   thread_info.can_capture = 0;
   pthread_create (&thread_info.thread_id, NULL, disk_thread, &thread_info);
+  if (! optHeadless)
+    pthread_create (&render_thread_id, NULL, render_thread, NULL);
 
-  jack_set_process_callback (client, jack_process, &thread_info);
-  jack_on_shutdown (client, jack_shutdown, &thread_info);
+  if ((! optRead) && (! optGen))
+  {
+    jack_set_process_callback (client, jack_process, &thread_info);
+    jack_on_shutdown (client, jack_shutdown, &thread_info);
 
-  if (jack_activate(client))
-    ERR(J, "Cannot activate client.");
+    if (jack_activate(client))
+      ERR(J, "Cannot activate client.");
+  }
 
   /* setup_ports: Allocate data structures that depend on the number of ports. */
-  nports = MIN(argc - optind, MAXCH);
+  nports = ((optRead) || (optGen)) ? jackPorts : MIN(argc - optind, MAXCH);
   ports = (jack_port_t **) malloc (sizeof (jack_port_t *) * nports);
   // ports = (jack_port_t **) malloc (sizeof (jack_port_t *) * MAXCH);
   uint64_t in_size = nports * sizeof (jack_default_audio_sample_t *);
@@ -2602,28 +5972,24 @@ int main(int argc, char *argv[])
   memset(jack_in, 0, in_size);
   memset(rb->buf, 0, rb->size);
 
-  for (int i = 0; i < nports; i++)
-  {
-    sprintf(portName[0], "input%d", i+1);
-
-    if ((ports[i] = jack_port_register (thread_info.client, portName[0], JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0)) == 0)
-      ERR(J, "Cannot register input port '%s'!", portName[0]);
-
-    sprintf(portName[i], argv[optind + i]);
+  if ((optRead) || (optGen))
+    pthread_create (&file_thread_id, NULL, file_thread, &thread_info);
+  else
+    for (int i = 0; i < nports; i++)
+    {
+      sprintf(portName[0], "input%d", i+1);
 
-    if (jack_connect (thread_info.client, portName[i], jack_port_name (ports[i])))
-      ERR (J, "Cannot connect input port '%s' to '%s'!", jack_port_name (ports[i]), portName[i]);
-  }
+      if ((ports[i] = jack_port_register (thread_info.client, portName[0], JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0)) == 0)
+        ERR(J, "Cannot register input port '%s'!", portName[0]);
 
+      sprintf(portName[i], argv[optind + i]);
 
-// Init internals
-  (spanHz < 0.1 * kHz) ? (units = Hz) : (units = kHz);
+      if (jack_connect (thread_info.client, portName[i], jack_port_name (ports[i])))
+        ERR (J, "Cannot connect input port '%s' to '%s'!", jack_port_name (ports[i]), portName[i]);
+    }
 
-  maxHz = sampleRate / 2;
-  minHz = optIQ ? -(int)maxHz : 0;
-  minSpanHz = xGrids;
-  maxSpanHz = sampleRate;
 
+// Engine state
   instrumentReset(1);
   if (! (windowBits & 16))
     sprintf(resultStr, "Greetings! Please read instruction manual before use.");